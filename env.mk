@@ -15,16 +15,22 @@ prefix ?= /usr
 libdir ?= $(prefix)/lib64
 sbindir ?= $(prefix)/sbin
 includedir ?= $(prefix)/include
+# The directory where libcryptsetup loads the external token plugins
+cryptsetup_tokendir ?= $(libdir)/cryptsetup
 
 tpm2_tss_includedir ?= $(includedir)
 tpm2_tss_libdir ?= $(libdir)
 
 tpm2_tabrmd_includedir ?= $(includedir)
 
+# Build the open subcommand and the LUKS2 token plugin with libcryptsetup
+with_cryptsetup ?= 1
+
 # For the installation
 DESTDIR ?=
 LIBDIR ?= $(libdir)
 SBINDIR ?= $(sbindir)
+TOKENDIR ?= $(cryptsetup_tokendir)
 
 # The authorization password for the primary key
 primary_key_secret ?= H31i05
@@ -43,9 +49,9 @@ CFLAGS := -D_GNU_SOURCE -std=gnu99 -O2 -Wall -Werror \
 	  $(EXTRA_CFLAGS) $(addprefix $(join -Wl,,),$(LDFLAGS))
 
 ifneq ($(TSS2_VER), 1)
-	CFLAGS += -ldl -ltss2-sys -ltss2-tcti-mssim -ltss2-tcti-device
+	CFLAGS += -ldl -lpthread -ltss2-sys -ltss2-tcti-mssim -ltss2-tcti-device
 else
-	CFLAGS += -ldl -lsapi -ltcti-socket -ltcti-device -DTSS2_LEGACY_V1
+	CFLAGS += -ldl -lpthread -lsapi -ltcti-socket -ltcti-device -DTSS2_LEGACY_V1
 endif
 
 ifneq ($(DEBUG_BUILD),)
@@ -0,0 +1,490 @@
+#!/bin/bash
+
+# Cryptfs-TPM2 benchmark script
+#
+# Copyright (c) 2024, Alibaba Cloud
+# Copyright (c) 2016-2023, Wind River Systems, Inc.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1) Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2) Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3) Neither the name of Wind River Systems nor the names of its contributors
+# may be used to endorse or promote products derived from this software
+# without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Usage: bench.sh [iterations]
+#
+# Run against a clear TPM, e.g, the IBM software TPM with TSS2_TCTI=socket.
+# Each case reports the average wall-clock time of one command.
+
+ITERATIONS="${1:-20}"
+
+function now_ns()
+{
+    date +%s%N
+}
+
+# bench_run <label> <command...>
+function bench_run()
+{
+    local label="$1"
+    shift
+
+    local start=$(now_ns)
+    local i
+
+    for i in `seq $ITERATIONS`; do
+        "$@" >/dev/null 2>&1 || {
+            printf "%-48s [FAILED]\n" "$label"
+            return 1
+        }
+    done
+
+    local end=$(now_ns)
+    local avg=$(( (end - start) / ITERATIONS / 1000 ))
+
+    printf "%-48s %8d.%03d ms\n" "$label" $((avg / 1000)) $((avg % 1000))
+}
+
+function bench_startup()
+{
+    echo "[*] startup without TPM commands"
+
+    bench_run "  cryptfs-tpm2 --version" cryptfs-tpm2 --version
+    bench_run "  cryptfs-tpm2 --help" cryptfs-tpm2 --help
+    bench_run "  cryptfs-tpm2 help unseal" cryptfs-tpm2 -q help unseal
+}
+
+function bench_hash()
+{
+    local bank="$1"
+
+    echo "[*] digest engine ($bank PCR bank)"
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+    cryptfs-tpm2 -q seal all -P $bank >/dev/null 2>&1 || {
+        echo "Unable to seal all with $bank PCR bank"
+        return 1
+    }
+
+    bench_run "  unseal (host digest)" \
+        cryptfs-tpm2 -q unseal passphrase -P $bank --pcr-digest \
+            -o /dev/null
+    bench_run "  unseal (TPM digest)" \
+        cryptfs-tpm2 -q --tpm-hash unseal passphrase -P $bank --pcr-digest \
+            -o /dev/null
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+}
+
+function bench_policy()
+{
+    local bank="$1"
+
+    echo "[*] PolicyPCR ($bank PCR bank)"
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+    cryptfs-tpm2 -q seal all -P $bank >/dev/null 2>&1 || {
+        echo "Unable to seal all with $bank PCR bank"
+        return 1
+    }
+
+    bench_run "  unseal (current PCRs)" \
+        cryptfs-tpm2 -q unseal passphrase -P $bank -o /dev/null
+    bench_run "  unseal (PCR digest)" \
+        cryptfs-tpm2 -q unseal passphrase -P $bank --pcr-digest \
+            -o /dev/null
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+}
+
+function bench_agent()
+{
+    local bank="$1"
+    local sock="/tmp/cryptfs-tpm2-bench-agent.sock"
+
+    echo "[*] agent ($bank PCR bank)"
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+    cryptfs-tpm2 -q seal all -P $bank >/dev/null 2>&1 || {
+        echo "Unable to seal all with $bank PCR bank"
+        return 1
+    }
+
+    cryptfs-tpm2 -q agent -s "$sock" >/dev/null 2>&1 &
+    local pid=$!
+
+    while [ ! -S "$sock" ]; do
+        kill -0 $pid 2>/dev/null || {
+            echo "Unable to start the agent"
+            return 1
+        }
+        sleep 0.01
+    done
+
+    bench_run "  unseal (one-shot)" \
+        cryptfs-tpm2 -q unseal passphrase -P $bank -o /dev/null
+    bench_run "  unseal (agent)" \
+        cryptfs-tpm2 -q unseal passphrase -P $bank --agent "$sock" \
+            -o /dev/null
+    bench_run "  status (agent)" \
+        cryptfs-tpm2 -q agent -s "$sock" --status
+
+    # Throughput with 4 concurrent clients
+    local start=$(now_ns)
+    local i
+
+    for i in 1 2 3 4; do
+        (for j in `seq $ITERATIONS`; do
+            cryptfs-tpm2 -q unseal passphrase -P $bank --agent "$sock" \
+                -o /dev/null >/dev/null 2>&1
+        done) &
+    done
+    wait $(jobs -p | grep -v "^$pid$")
+
+    local end=$(now_ns)
+    local ms=$(( (end - start) / 1000000 ))
+
+    printf "%-48s %8d req/s\n" "  unseal (agent, 4 clients)" \
+        $(( ITERATIONS * 4 * 1000 / (ms ? ms : 1) ))
+
+    kill $pid
+    wait $pid 2>/dev/null
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+}
+
+function open_with_cryptsetup()
+{
+    cryptfs-tpm2 -q unseal passphrase -P "$1" \
+        --exec "cryptsetup luksOpen --key-file - $2 $3" &&
+        cryptsetup luksClose "$3"
+}
+
+function open_in_process()
+{
+    cryptfs-tpm2 -q open "$2" "$3" -P "$1" &&
+        cryptsetup luksClose "$3"
+}
+
+# Requires BENCH_LUKS_DEV pointing to a scratch block device. CAUTION: it
+# is reformatted as LUKS with the sealed passphrase.
+function bench_open()
+{
+    local bank="$1"
+    local name="cryptfs-tpm2-bench"
+
+    echo "[*] LUKS activation ($bank PCR bank)"
+
+    [ -z "$BENCH_LUKS_DEV" ] && {
+        echo "  Skipped due to BENCH_LUKS_DEV not set"
+        return 0
+    }
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+    cryptfs-tpm2 -q seal all -P $bank >/dev/null 2>&1 || {
+        echo "Unable to seal all with $bank PCR bank"
+        return 1
+    }
+
+    cryptfs-tpm2 -q unseal passphrase -P $bank \
+        --exec "cryptsetup -q luksFormat --key-file - $BENCH_LUKS_DEV" \
+        >/dev/null 2>&1 || {
+        echo "Unable to format $BENCH_LUKS_DEV"
+        return 1
+    }
+
+    bench_run "  unseal + cryptsetup luksOpen" \
+        open_with_cryptsetup $bank "$BENCH_LUKS_DEV" $name
+    bench_run "  open (libcryptsetup)" \
+        open_in_process $bank "$BENCH_LUKS_DEV" $name
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+}
+
+function open_with_volume_key()
+{
+    cryptfs-tpm2 -q unseal volume-key -P "$1" \
+        --exec "cryptsetup luksOpen --master-key-file /proc/self/fd/\$CRYPTFS_TPM2_KEY_FD $2 $3" &&
+        cryptsetup luksClose "$3"
+}
+
+# peak_rss <label> <command...>
+function peak_rss()
+{
+    local label="$1"
+    shift
+
+    [ ! -x /usr/bin/time ] && return 0
+
+    local rss=$(/usr/bin/time -f "%M" "$@" 2>&1 >/dev/null | tail -1)
+
+    printf "%-48s %8s KiB\n" "$label" "$rss"
+}
+
+# Compare opening the keyslot with the sealed passphrase against
+# activating with the sealed volume key on a loop device. Requires root.
+function bench_volume_key()
+{
+    local bank="$1"
+    local img="/tmp/cryptfs-tpm2-bench.img"
+    local vk="/tmp/cryptfs-tpm2-bench.vk"
+    local name="cryptfs-tpm2-bench"
+    local dev=""
+
+    echo "[*] passphrase vs. volume key on loop device ($bank PCR bank)"
+
+    truncate -s 64M "$img" 2>/dev/null &&
+        dev=$(losetup -f --show "$img" 2>/dev/null)
+    [ -z "$dev" ] && {
+        echo "  Skipped due to no loop device available"
+        rm -f "$img"
+        return 0
+    }
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+    cryptfs-tpm2 -q seal all -P $bank >/dev/null 2>&1 || {
+        echo "Unable to seal all with $bank PCR bank"
+        return 1
+    }
+
+    # Use the default keyslot KDF chosen by cryptsetup, e.g, argon2id
+    cryptfs-tpm2 -q unseal passphrase -P $bank \
+        --exec "cryptsetup -q luksFormat --type luks2 --key-file - $dev" \
+        >/dev/null 2>&1 || {
+        echo "Unable to format $dev"
+        return 1
+    }
+
+    bench_run "  luksOpen (passphrase)" \
+        open_with_cryptsetup $bank $dev $name
+    peak_rss "  luksOpen (passphrase) peak RSS" \
+        cryptfs-tpm2 -q unseal passphrase -P $bank \
+            --exec "cryptsetup luksOpen --key-file - $dev $name"
+    cryptsetup luksClose $name
+
+    cryptfs-tpm2 -q unseal passphrase -P $bank \
+        --exec "cryptsetup luksDump --dump-master-key --master-key-file $vk --key-file - -q $dev" \
+        >/dev/null 2>&1 &&
+        cryptfs-tpm2 -q evict passphrase >/dev/null 2>&1 &&
+        cryptfs-tpm2 -q seal volume-key -p $vk -P $bank >/dev/null 2>&1
+    local err=$?
+    rm -f "$vk"
+
+    if [ $err -eq 0 ]; then
+        bench_run "  luksOpen (volume key)" \
+            open_with_volume_key $bank $dev $name
+        peak_rss "  luksOpen (volume key) peak RSS" \
+            cryptfs-tpm2 -q unseal volume-key -P $bank \
+                --exec "cryptsetup luksOpen --master-key-file /proc/self/fd/\$CRYPTFS_TPM2_KEY_FD $dev $name"
+        cryptsetup luksClose $name
+    else
+        echo "Unable to seal the volume key"
+    fi
+
+    losetup -d $dev
+    rm -f "$img"
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+}
+
+function provision_key()
+{
+    cryptfs-tpm2 -q seal key --key-type "$1" &&
+        cryptfs-tpm2 -q evict key
+}
+
+# Provisioning latency is dominated by TPM2_CreatePrimary, which differs
+# a lot between the primary key types.
+function bench_key_type()
+{
+    echo "[*] primary key provisioning"
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+
+    bench_run "  seal key (ecc)" provision_key ecc
+    bench_run "  seal key (rsa)" provision_key rsa
+}
+
+function provision_all()
+{
+    cryptfs-tpm2 -q seal all --parent "$1" &&
+        cryptfs-tpm2 -q evict passphrase &&
+        { [ "$1" = "srk" ] || cryptfs-tpm2 -q evict key; }
+}
+
+# Compare sealing under the own primary key against reusing the TCG SRK,
+# which is provisioned with tpm2-tools if absent.
+function bench_parent()
+{
+    echo "[*] passphrase parent provisioning"
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+
+    bench_run "  seal all (primary key)" provision_all key
+
+    tpm2_readpublic -c 0x81000001 >/dev/null 2>&1 || {
+        tpm2_createprimary -C o -g sha256 -G rsa -c /tmp/srk.ctx \
+            >/dev/null 2>&1 &&
+            tpm2_evictcontrol -C o -c /tmp/srk.ctx 0x81000001 \
+            >/dev/null 2>&1
+        rm -f /tmp/srk.ctx
+    }
+
+    bench_run "  seal all (SRK)" provision_all srk
+}
+
+function provision_passphrase()
+{
+    cryptfs-tpm2 -q seal passphrase "$@" &&
+        cryptfs-tpm2 -q evict passphrase
+}
+
+# TPM2_CreateLoaded replaces TPM2_Create plus TPM2_Load if the TPM
+# supports it. Otherwise both cases run the same two-step flow.
+function bench_create_loaded()
+{
+    echo "[*] passphrase creation"
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+    cryptfs-tpm2 -q seal key >/dev/null 2>&1 || {
+        echo "Unable to seal the primary key"
+        return 1
+    }
+
+    bench_run "  seal passphrase (CreateLoaded)" provision_passphrase
+    bench_run "  seal passphrase (Create + Load)" provision_passphrase \
+        --no-create-loaded
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+}
+
+# Count the TPM commands issued by one run, from the trace events
+function count_commands()
+{
+    local label="$1"
+    local trace="/tmp/cryptfs-tpm2-bench.trace"
+    shift
+
+    rm -f "$trace"
+    cryptfs-tpm2 -q --trace "$trace" "$@" >/dev/null 2>&1 || {
+        printf "%-48s [FAILED]\n" "$label"
+        return 1
+    }
+
+    printf "%-48s %8d cmds\n" "$label" \
+        `grep -c '"cat":"tpm2"' "$trace"`
+    rm -f "$trace"
+}
+
+# Compare the sealed object against the NV index, with and without the
+# PCR binding. The NV index without the PCR binding is a single NV_Read.
+function bench_nv()
+{
+    local bank="$1"
+
+    echo "[*] passphrase storage ($bank PCR bank)"
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+    cryptfs-tpm2 -q evict passphrase --nv >/dev/null 2>&1
+    cryptfs-tpm2 -q seal all -P $bank >/dev/null 2>&1 || {
+        echo "Unable to seal all with $bank PCR bank"
+        return 1
+    }
+
+    bench_run "  unseal (object)" \
+        cryptfs-tpm2 -q unseal passphrase -P $bank -o /dev/null
+    count_commands "  unseal (object)" \
+        unseal passphrase -P $bank -o /dev/null
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+    cryptfs-tpm2 -q seal passphrase --nv -P $bank >/dev/null 2>&1 || {
+        echo "Unable to store the passphrase in the NV index"
+        return 1
+    }
+
+    bench_run "  unseal (NV index)" \
+        cryptfs-tpm2 -q unseal passphrase --nv -P $bank -o /dev/null
+    count_commands "  unseal (NV index)" \
+        unseal passphrase --nv -P $bank -o /dev/null
+
+    cryptfs-tpm2 -q evict passphrase --nv >/dev/null 2>&1
+    cryptfs-tpm2 -q seal passphrase --nv >/dev/null 2>&1 || {
+        echo "Unable to store the passphrase in the NV index"
+        return 1
+    }
+
+    bench_run "  unseal (NV index without PCR)" \
+        cryptfs-tpm2 -q unseal passphrase --nv -o /dev/null
+    count_commands "  unseal (NV index without PCR)" \
+        unseal passphrase --nv -o /dev/null
+
+    cryptfs-tpm2 -q evict passphrase --nv >/dev/null 2>&1
+}
+
+# Compare the persistent passphrase object against the blob which is
+# loaded and flushed on every unseal.
+function bench_blob()
+{
+    local bank="$1"
+    local blob="/tmp/cryptfs-tpm2-bench.blob"
+
+    echo "[*] passphrase blob ($bank PCR bank)"
+
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+    cryptfs-tpm2 -q seal all -P $bank >/dev/null 2>&1 || {
+        echo "Unable to seal all with $bank PCR bank"
+        return 1
+    }
+
+    cryptfs-tpm2 -q seal passphrase -P $bank --blob "$blob" >/dev/null 2>&1 || {
+        echo "Unable to seal the passphrase to the blob"
+        return 1
+    }
+
+    bench_run "  unseal (persistent)" \
+        cryptfs-tpm2 -q unseal passphrase -P $bank -o /dev/null
+    count_commands "  unseal (persistent)" \
+        unseal passphrase -P $bank -o /dev/null
+    bench_run "  unseal (blob)" \
+        cryptfs-tpm2 -q unseal passphrase -P $bank --blob "$blob" -o /dev/null
+    count_commands "  unseal (blob)" \
+        unseal passphrase -P $bank --blob "$blob" -o /dev/null
+
+    rm -f "$blob"
+    cryptfs-tpm2 -q evict all >/dev/null 2>&1
+}
+
+echo "Running each case $ITERATIONS times ..."
+
+bench_startup
+bench_key_type
+bench_parent
+bench_create_loaded
+bench_hash sha1
+bench_hash sha256
+bench_policy sha256
+bench_nv sha256
+bench_blob sha256
+bench_agent sha256
+bench_open sha256
+bench_volume_key sha256
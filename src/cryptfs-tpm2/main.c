@@ -78,6 +78,13 @@ show_usage(const char *prog)
 		  "    Prompt the user to type owner authentication, "
 		  "the secret info of the primary key or passphrase.\n"
 		  "    Default: FALSE\n");
+	info_cont("  --tpm-hash:\n"
+		  "    Calculate the digests with TPM instead of the "
+		  "host-side digest engine.\n"
+		  "    Default: FALSE\n");
+	info_cont("  --trace <file>:\n"
+		  "    Record the latency of each TPM command and write "
+		  "it to the file in Chrome trace format\n");
 	info_cont("\nsubcommand:\n");
 	info_cont("  help:\n"
 		  "    Display the help information for the "
@@ -87,8 +94,13 @@ show_usage(const char *prog)
 		  "passphrase\n");
 	info_cont("  unseal:\n"
 		  "    Unseal the passphrase\n");
+	info_cont("  open:\n"
+		  "    Unseal the passphrase and open the LUKS device\n");
 	info_cont("  evict:\n"
 		  "    Evict the persistent primary key and passphrase\n");
+	info_cont("  agent:\n"
+		  "    Serve the seal and unseal requests over a Unix "
+		  "socket with a persistent TPM connection\n");
 	info_cont("\nargs:\n");
 	info_cont("  Run `%s help <subcommand>` for the details\n", prog);
 }
@@ -99,6 +111,8 @@ show_usage(const char *prog)
 #define EXTRA_OPT_KEY_SECRET_AUTH		(EXTRA_OPT_BASE + 2)
 #define EXTRA_OPT_PASSPHRASE_SECRET_AUTH	(EXTRA_OPT_BASE + 3)
 #define EXTRA_OPT_INTERACTIVE			(EXTRA_OPT_BASE + 4)
+#define EXTRA_OPT_TPM_HASH			(EXTRA_OPT_BASE + 5)
+#define EXTRA_OPT_TRACE				(EXTRA_OPT_BASE + 6)
 
 static int
 parse_options(int argc, char *argv[])
@@ -119,6 +133,10 @@ parse_options(int argc, char *argv[])
 		  EXTRA_OPT_PASSPHRASE_SECRET_AUTH },
 		{ "interactive", no_argument, NULL,
 		  EXTRA_OPT_INTERACTIVE },
+		{ "tpm-hash", no_argument, NULL,
+		  EXTRA_OPT_TPM_HASH },
+		{ "trace", required_argument, NULL,
+		  EXTRA_OPT_TRACE },
 		{ 0 },	/* NULL terminated */
 	};
 
@@ -177,6 +195,13 @@ parse_options(int argc, char *argv[])
 		case EXTRA_OPT_INTERACTIVE:
 			cryptfs_tpm2_option_set_interactive();
 			break;
+		case EXTRA_OPT_TPM_HASH:
+			cryptfs_tpm2_option_set_tpm_hash();
+			break;
+		case EXTRA_OPT_TRACE:
+			if (cryptfs_tpm2_trace_start(optarg))
+				return -1;
+			break;
 		case 1:
 			index = optind;
 			return subcommand_parse(argv[0], optarg,
@@ -197,6 +222,10 @@ extern subcommand_t subcommand_help;
 extern subcommand_t subcommand_evict;
 extern subcommand_t subcommand_seal;
 extern subcommand_t subcommand_unseal;
+extern subcommand_t subcommand_agent;
+#ifdef WITH_CRYPTSETUP
+extern subcommand_t subcommand_open;
+#endif
 
 static void
 exit_notify(void)
@@ -215,6 +244,10 @@ main(int argc, char *argv[], char *envp[])
 	subcommand_add(&subcommand_evict);
 	subcommand_add(&subcommand_seal);
 	subcommand_add(&subcommand_unseal);
+	subcommand_add(&subcommand_agent);
+#ifdef WITH_CRYPTSETUP
+	subcommand_add(&subcommand_open);
+#endif
 
 	int rc = parse_options(argc, argv);
 	if (rc)
@@ -223,5 +256,9 @@ main(int argc, char *argv[], char *envp[])
 	if (!option_quite)
 		show_banner();
 
-	return subcommand_run_current();
+	rc = subcommand_run_current();
+
+	cryptfs_tpm2_trace_stop();
+
+	return rc;
 }
@@ -0,0 +1,645 @@
+/*
+ * Copyright (c) 2024, Alibaba Cloud
+ * Copyright (c) 2016-2023, Wind River Systems, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1) Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2) Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3) Neither the name of Wind River Systems nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author:
+ *        Jia Zhang <zhang.jia@linux.alibaba.com>
+ */
+
+#include <cryptfs_tpm2.h>
+
+/*
+ * The agent keeps one TPM connection and the capability state warm, and
+ * serves the requests from the clients over an AF_UNIX socket. Each
+ * client connection is handled by its own thread, while all the TPM
+ * commands are issued by a single worker thread draining the request
+ * queue in order.
+ */
+
+typedef struct agent_job {
+	struct agent_job *next;
+	cryptfs_tpm2_agent_header_t hdr;
+	uint8_t *payload;
+	int32_t status;
+	uint8_t *rsp;
+	uint32_t rsp_size;
+	bool done;
+	pthread_cond_t done_cond;
+} agent_job_t;
+
+/* The client connections served at the same time */
+#define AGENT_MAX_CLIENTS	64
+
+static const char *opt_socket = CRYPTFS_TPM2_AGENT_SOCKET;
+static bool opt_status;
+
+static agent_job_t *job_head;
+static agent_job_t **job_tail = &job_head;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t nr_request;
+static uint32_t nr_pending;
+static bool worker_stopping;
+static uint32_t nr_client;
+static time_t start_time;
+static volatile sig_atomic_t agent_exiting;
+
+static void
+show_usage(char *prog)
+{
+	info_cont("\nUsage: %s <options> agent <args>\n", prog);
+	info_cont("\nargs:\n");
+	info_cont("  --socket, -s:\n"
+		  "    (optional) The socket path the agent listens on.\n"
+		  "    Default: %s\n", CRYPTFS_TPM2_AGENT_SOCKET);
+	info_cont("  --status:\n"
+		  "    (optional) Query the status of the running agent\n"
+		  "    instead of starting the agent.\n");
+}
+
+#define EXTRA_OPT_BASE			0x8300
+#define EXTRA_OPT_STATUS		(EXTRA_OPT_BASE + 0)
+
+static int
+parse_arg(int opt, char *optarg)
+{
+	switch (opt) {
+	case 's':
+		opt_socket = optarg;
+		break;
+	case EXTRA_OPT_STATUS:
+		opt_status = true;
+		break;
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+resolve_pcr_bank(uint16_t pcr_bank_alg, TPMI_ALG_HASH *bank_alg)
+{
+	*bank_alg = pcr_bank_alg;
+
+	if (*bank_alg == TPM2_ALG_NULL)
+		return 0;
+
+	/* Reuse the PCR bank already voted */
+	if (*bank_alg == TPM2_ALG_AUTO &&
+	    cryptfs_tpm2_capability_get_voted_pcr_bank(bank_alg, NULL) ==
+	    EXIT_SUCCESS)
+		return 0;
+
+	if (cryptfs_tpm2_capability_pcr_bank_supported(bank_alg) == false) {
+		err("Unsupported PCR bank algorithm %#x\n", pcr_bank_alg);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int32_t
+handle_status(agent_job_t *job)
+{
+	cryptfs_tpm2_agent_status_t *status;
+	bool in_lockout = false;
+
+	status = calloc(1, sizeof(*status));
+	if (!status)
+		return -1;
+
+	/* The lockout state may be changed by others */
+	cryptfs_tpm2_capability_invalidate();
+	cryptfs_tpm2_capability_in_lockout(&in_lockout);
+
+	TPMI_ALG_HASH bank_alg = TPM2_ALG_NULL;
+
+	cryptfs_tpm2_capability_get_voted_pcr_bank(&bank_alg, NULL);
+
+	pthread_mutex_lock(&job_lock);
+	status->nr_request = nr_request;
+	status->nr_pending = nr_pending;
+	pthread_mutex_unlock(&job_lock);
+
+	status->pid = getpid();
+	status->uptime = time(NULL) - start_time;
+	status->pcr_bank_alg = bank_alg;
+	status->in_lockout = in_lockout;
+
+	job->rsp = (uint8_t *)status;
+	job->rsp_size = sizeof(*status);
+
+	return 0;
+}
+
+static int32_t
+handle_unseal(agent_job_t *job)
+{
+	cryptfs_tpm2_agent_request_t *req;
+	TPMI_ALG_HASH bank_alg;
+
+	if (job->hdr.payload_size != sizeof(*req))
+		return -1;
+
+	req = (cryptfs_tpm2_agent_request_t *)job->payload;
+	if (resolve_pcr_bank(req->pcr_bank_alg, &bank_alg))
+		return -1;
+
+	void *passphrase;
+	size_t passphrase_size;
+	int rc;
+
+	option_pcr_digest = !!(req->flags & CRYPTFS_TPM2_AGENT_FLAG_PCR_DIGEST);
+	option_nv = !!(req->objects & CRYPTFS_TPM2_AGENT_OBJECT_NV);
+	rc = cryptfs_tpm2_unseal_passphrase(bank_alg, &passphrase,
+					    &passphrase_size);
+	option_pcr_digest = false;
+	option_nv = false;
+	if (rc)
+		return -1;
+
+	job->rsp = passphrase;
+	job->rsp_size = passphrase_size;
+
+	return 0;
+}
+
+static int32_t
+handle_seal(agent_job_t *job)
+{
+	cryptfs_tpm2_agent_request_t *req;
+	TPMI_ALG_HASH bank_alg;
+
+	if (job->hdr.payload_size < sizeof(*req))
+		return -1;
+
+	req = (cryptfs_tpm2_agent_request_t *)job->payload;
+
+	size_t passphrase_size = job->hdr.payload_size - sizeof(*req);
+	size_t max_size = CRYPTFS_TPM2_PASSPHRASE_MAX_SIZE;
+
+	/* Only the volume key is allowed to exceed the passphrase limit */
+	if (req->objects & CRYPTFS_TPM2_AGENT_OBJECT_VOLUME_KEY)
+		max_size = CRYPTFS_TPM2_VOLUME_KEY_MAX_SIZE;
+
+	if (passphrase_size > max_size) {
+		err("The passphrase explicitly specified is too long\n");
+		return -1;
+	}
+
+	/* The persistent objects may be created or evicted by others */
+	cryptfs_tpm2_capability_invalidate();
+
+	if (resolve_pcr_bank(req->pcr_bank_alg, &bank_alg))
+		return -1;
+
+	int32_t rc = 0;
+
+	/* The options are only applied to this request */
+	option_no_da = !!(req->flags & CRYPTFS_TPM2_AGENT_FLAG_NO_DA);
+	option_check_policy = !!(req->flags &
+				 CRYPTFS_TPM2_AGENT_FLAG_CHECK_POLICY);
+	option_no_create_loaded = !!(req->flags &
+				     CRYPTFS_TPM2_AGENT_FLAG_NO_CREATE_LOADED);
+	option_nv = !!(req->objects & CRYPTFS_TPM2_AGENT_OBJECT_NV);
+
+	TPMI_ALG_PUBLIC key_type = TPM2_ALG_NULL;
+
+	if (req->flags & CRYPTFS_TPM2_AGENT_FLAG_KEY_RSA)
+		key_type = TPM2_ALG_RSA;
+	else if (req->flags & CRYPTFS_TPM2_AGENT_FLAG_KEY_ECC)
+		key_type = TPM2_ALG_ECC;
+
+	cryptfs_tpm2_parent_t parent_mode = CRYPTFS_TPM2_PARENT_KEY;
+	TPMI_DH_OBJECT parent = CRYPTFS_TPM2_PRIMARY_KEY_HANDLE;
+
+	if (req->flags & CRYPTFS_TPM2_AGENT_FLAG_PARENT_SRK)
+		parent_mode = CRYPTFS_TPM2_PARENT_SRK;
+	else if (req->flags & CRYPTFS_TPM2_AGENT_FLAG_PARENT_AUTO)
+		parent_mode = CRYPTFS_TPM2_PARENT_AUTO;
+
+	/* The NV index needs neither the parent nor the primary key */
+	if (option_nv == false &&
+	    cryptfs_tpm2_select_parent(parent_mode, &parent))
+		rc = -1;
+
+	if (!rc && (req->objects & CRYPTFS_TPM2_AGENT_OBJECT_KEY) &&
+	    option_nv == false &&
+	    parent == CRYPTFS_TPM2_PRIMARY_KEY_HANDLE &&
+	    cryptfs_tpm2_create_primary_key(bank_alg, key_type))
+		rc = -1;
+
+	if (!rc && (req->objects & CRYPTFS_TPM2_AGENT_OBJECT_PASSPHRASE)) {
+		char *passphrase = NULL;
+
+		if (passphrase_size)
+			passphrase = (char *)(req + 1);
+
+		if (cryptfs_tpm2_create_passphrase(passphrase,
+						   passphrase_size,
+						   bank_alg, parent))
+			rc = -1;
+	}
+
+	option_no_da = false;
+	option_check_policy = false;
+	option_no_create_loaded = false;
+	option_nv = false;
+
+	return rc;
+}
+
+static void *
+worker_thread(void *arg)
+{
+	while (1) {
+		pthread_mutex_lock(&job_lock);
+
+		while (!job_head && worker_stopping == false)
+			pthread_cond_wait(&job_cond, &job_lock);
+
+		if (worker_stopping == true) {
+			pthread_mutex_unlock(&job_lock);
+			break;
+		}
+
+		agent_job_t *job = job_head;
+
+		job_head = job->next;
+		if (!job_head)
+			job_tail = &job_head;
+
+		pthread_mutex_unlock(&job_lock);
+
+		switch (job->hdr.command) {
+		case CRYPTFS_TPM2_AGENT_STATUS:
+			job->status = handle_status(job);
+			break;
+		case CRYPTFS_TPM2_AGENT_UNSEAL:
+			job->status = handle_unseal(job);
+			break;
+		case CRYPTFS_TPM2_AGENT_SEAL:
+			job->status = handle_seal(job);
+			break;
+		default:
+			err("Unrecognized agent request (%d)\n",
+			    job->hdr.command);
+			job->status = -1;
+			break;
+		}
+
+		pthread_mutex_lock(&job_lock);
+		--nr_pending;
+		job->done = true;
+		pthread_cond_signal(&job->done_cond);
+		pthread_mutex_unlock(&job_lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * Stop the worker thread once the TPM command in progress is done, and
+ * fail the requests still queued. The TPM connection is only torn down
+ * after that.
+ */
+static void
+stop_worker(pthread_t worker)
+{
+	pthread_mutex_lock(&job_lock);
+	worker_stopping = true;
+	pthread_cond_signal(&job_cond);
+	pthread_mutex_unlock(&job_lock);
+
+	pthread_join(worker, NULL);
+
+	pthread_mutex_lock(&job_lock);
+	while (job_head) {
+		agent_job_t *job = job_head;
+
+		job_head = job->next;
+		--nr_pending;
+		job->done = true;
+		pthread_cond_signal(&job->done_cond);
+	}
+	job_tail = &job_head;
+	pthread_mutex_unlock(&job_lock);
+}
+
+static bool
+client_allowed(int fd)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len)) {
+		err("Unable to get the credential of client (%s)\n",
+		    strerror(errno));
+		return false;
+	}
+
+	if (cred.uid && cred.uid != geteuid()) {
+		err("Reject the client with uid %d\n", cred.uid);
+		return false;
+	}
+
+	return true;
+}
+
+static void *
+client_thread(void *arg)
+{
+	int fd = (int)(intptr_t)arg;
+
+	if (client_allowed(fd) == false)
+		goto out;
+
+	while (1) {
+		agent_job_t job = {
+			.status = -1,
+		};
+
+		if (cryptfs_tpm2_agent_recv(fd, &job.hdr, &job.payload))
+			break;
+
+		pthread_cond_init(&job.done_cond, NULL);
+
+		pthread_mutex_lock(&job_lock);
+		if (worker_stopping == true) {
+			pthread_mutex_unlock(&job_lock);
+			pthread_cond_destroy(&job.done_cond);
+			if (job.payload) {
+				memset(job.payload, 0, job.hdr.payload_size);
+				free(job.payload);
+			}
+			break;
+		}
+
+		*job_tail = &job;
+		job_tail = &job.next;
+		++nr_request;
+		++nr_pending;
+		pthread_cond_signal(&job_cond);
+
+		while (job.done == false)
+			pthread_cond_wait(&job.done_cond, &job_lock);
+		pthread_mutex_unlock(&job_lock);
+
+		pthread_cond_destroy(&job.done_cond);
+
+		int rc = cryptfs_tpm2_agent_send(fd, job.hdr.command,
+						 job.status, job.rsp,
+						 job.rsp_size);
+
+		if (job.payload) {
+			memset(job.payload, 0, job.hdr.payload_size);
+			free(job.payload);
+		}
+
+		if (job.rsp) {
+			memset(job.rsp, 0, job.rsp_size);
+			free(job.rsp);
+		}
+
+		if (rc)
+			break;
+	}
+
+out:
+	close(fd);
+
+	pthread_mutex_lock(&job_lock);
+	--nr_client;
+	pthread_mutex_unlock(&job_lock);
+
+	return NULL;
+}
+
+/*
+ * The termination signals are only handled by the main thread, so that
+ * they are able to break accept(). The thread is detached unless the
+ * caller is going to join it.
+ */
+static int
+create_thread(void *(*fn)(void *), void *arg, pthread_t *joinable)
+{
+	sigset_t set, old_set;
+	pthread_t thread;
+	int rc;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &set, &old_set);
+
+	rc = pthread_create(&thread, NULL, fn, arg);
+	if (!rc) {
+		if (joinable)
+			*joinable = thread;
+		else
+			pthread_detach(thread);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+	return rc;
+}
+
+static void
+agent_signal_handler(int signo)
+{
+	agent_exiting = 1;
+}
+
+static int
+listen_socket(const char *socket_path)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		err("The agent socket path is too long\n");
+		return -1;
+	}
+
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		err("Unable to create the agent socket (%s)\n",
+		    strerror(errno));
+		return -1;
+	}
+
+	unlink(socket_path);
+
+	/* Only the owner is allowed to talk to the agent */
+	mode_t mask = umask(0177);
+	int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+
+	if (rc || listen(fd, SOMAXCONN)) {
+		err("Unable to listen on %s (%s)\n", socket_path,
+		    strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int
+show_status(void)
+{
+	cryptfs_tpm2_agent_status_t *status;
+	uint32_t size;
+	int rc;
+
+	rc = cryptfs_tpm2_agent_call(opt_socket, CRYPTFS_TPM2_AGENT_STATUS,
+				     NULL, 0, (uint8_t **)&status, &size);
+	if (rc)
+		return rc;
+
+	if (size != sizeof(*status)) {
+		err("Invalid agent status\n");
+		free(status);
+		return -1;
+	}
+
+	info_cont("pid: %d\n", status->pid);
+	info_cont("uptime: %d seconds\n", status->uptime);
+	info_cont("requests: %d\n", status->nr_request);
+	info_cont("pending requests: %d\n", status->nr_pending);
+	info_cont("voted PCR bank: %#x\n", status->pcr_bank_alg);
+	info_cont("in lockout: %s\n", status->in_lockout ? "yes" : "no");
+
+	free(status);
+
+	return 0;
+}
+
+static int
+run_agent(char *prog)
+{
+	if (opt_status == true)
+		return show_status();
+
+	int fd = listen_socket(opt_socket);
+	if (fd < 0)
+		return -1;
+
+	if (cryptfs_tpm2_init()) {
+		err("Unable to connect to TPM\n");
+		close(fd);
+		unlink(opt_socket);
+		return -1;
+	}
+
+	struct sigaction sa = {
+		.sa_handler = agent_signal_handler,
+	};
+
+	/* No SA_RESTART in order to break accept() */
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+
+	start_time = time(NULL);
+
+	pthread_t worker;
+
+	if (create_thread(worker_thread, NULL, &worker)) {
+		err("Unable to create the worker thread\n");
+		close(fd);
+		unlink(opt_socket);
+		return -1;
+	}
+
+	info("cryptfs-tpm2 agent is listening on %s\n", opt_socket);
+
+	while (!agent_exiting) {
+		int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+
+		if (client < 0) {
+			if (errno == EINTR)
+				continue;
+
+			err("Unable to accept the client (%s)\n",
+			    strerror(errno));
+			break;
+		}
+
+		pthread_mutex_lock(&job_lock);
+		bool busy = nr_client >= AGENT_MAX_CLIENTS;
+		if (!busy)
+			++nr_client;
+		pthread_mutex_unlock(&job_lock);
+
+		if (busy) {
+			warn("Reject the client due to too many clients\n");
+			close(client);
+			continue;
+		}
+
+		if (create_thread(client_thread, (void *)(intptr_t)client,
+				  NULL)) {
+			err("Unable to create the client thread\n");
+			close(client);
+
+			pthread_mutex_lock(&job_lock);
+			--nr_client;
+			pthread_mutex_unlock(&job_lock);
+		}
+	}
+
+	close(fd);
+	unlink(opt_socket);
+
+	stop_worker(worker);
+
+	info("cryptfs-tpm2 agent exiting\n");
+
+	return 0;
+}
+
+static struct option long_opts[] = {
+	{ "socket", required_argument, NULL, 's' },
+	{ "status", no_argument, NULL, EXTRA_OPT_STATUS },
+	{ 0 },	/* NULL terminated */
+};
+
+subcommand_t subcommand_agent = {
+	.name = "agent",
+	.optstring = "-s:",
+	.long_opts = long_opts,
+	.parse_arg = parse_arg,
+	.show_usage = show_usage,
+	.run = run_agent,
+};
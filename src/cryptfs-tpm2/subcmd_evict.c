@@ -44,10 +44,19 @@ show_usage(char *prog)
 	info_cont("\nobject:\n");
 	info_cont("  The object to be evicted. The allowed values are:\n"
 		  "  - passphrase: Passphrase used to encrypt LUKS\n"
+		  "  - volume-key: LUKS volume key sealed in place of\n"
+		  "    the passphrase\n"
 		  "  - key: Primary key used to seal the passphrase\n"
 		  "  - all: All above\n");
+	info_cont("\nargs:\n");
+	info_cont("  --nv:\n"
+		  "    (optional) Undefine the NV index holding the\n"
+		  "    passphrase stored by seal --nv.\n");
 }
 
+#define EXTRA_OPT_BASE			0x8500
+#define EXTRA_OPT_NV			(EXTRA_OPT_BASE + 0)
+
 static int
 parse_arg(int opt, char *optarg)
 {
@@ -55,7 +64,8 @@ parse_arg(int opt, char *optarg)
 	case 1:
 		if (!strcasecmp(optarg, "key"))
 			opt_evict_key = 1;
-		else if (!strcasecmp(optarg, "passphrase"))
+		else if (!strcasecmp(optarg, "passphrase") ||
+			 !strcasecmp(optarg, "volume-key"))
 			opt_evict_passphrase = 1;
 		else if (!strcasecmp(optarg, "all")) {
 			opt_evict_key = 1;
@@ -65,6 +75,9 @@ parse_arg(int opt, char *optarg)
 			return -1;
 		}
                 break;
+	case EXTRA_OPT_NV:
+		option_nv = true;
+		break;
 	default:
 		return -1;
 	}
@@ -80,10 +93,14 @@ run_evict(char *prog)
 	if (opt_evict_passphrase) {
 		rc = cryptfs_tpm2_evict_passphrase();
 		if (!rc)
-			info("The persistent passphrase is evicted\n");
+			info("The %s passphrase is evicted\n",
+			     option_nv == true ? "NV" : "persistent");
 	}
 
-	if (opt_evict_key) {
+	if (opt_evict_key && option_nv == true)
+		info("Skip evicting the primary key which is not used by "
+		     "the NV index\n");
+	else if (opt_evict_key) {
 		int rc1 = cryptfs_tpm2_evict_primary_key();
 		if (!rc1)
 			info("The persistent primary key is evicted\n");
@@ -95,6 +112,7 @@ run_evict(char *prog)
 }
 
 static struct option long_opts[] = {
+	{ "nv", no_argument, NULL, EXTRA_OPT_NV },
 	{ 0 },	/* NULL terminated */
 };
 
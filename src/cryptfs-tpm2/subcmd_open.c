@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2024, Alibaba Cloud
+ * Copyright (c) 2016-2023, Wind River Systems, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1) Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2) Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3) Neither the name of Wind River Systems nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author:
+ *        Jia Zhang <zhang.jia@linux.alibaba.com>
+ */
+
+#include <cryptfs_tpm2.h>
+#include <libcryptsetup.h>
+
+static char *opt_device;
+static char *opt_name;
+static int opt_key_slot = CRYPT_ANY_SLOT;
+static bool opt_readonly;
+static bool opt_volume_key;
+static char *opt_blob;
+static TPMI_ALG_HASH opt_pcr_bank_alg = TPM2_ALG_NULL;
+
+static void
+show_usage(char *prog)
+{
+	info_cont("\nUsage: %s <options> open <device> <name> <args>\n",
+		  prog);
+	info_cont("\ndevice:\n");
+	info_cont("  The LUKS device to be opened\n");
+	info_cont("\nname:\n");
+	info_cont("  The name of the dm-crypt mapping to be created\n");
+	info_cont("\nargs:\n");
+	info_cont("  --pcr-bank-alg, -P:\n"
+		  "    (optional) Use the specified PCR bank to bind the\n"
+		  "    created primary key and passphrase.\n");
+	info_cont("  --key-slot, -k:\n"
+		  "    (optional) Only try the specified keyslot holding\n"
+		  "    the passphrase, instead of all keyslots.\n");
+	info_cont("  --readonly, -r:\n"
+		  "    (optional) Create a read-only mapping.\n");
+	info_cont("  --volume-key:\n"
+		  "    (optional) The sealed object is the LUKS volume key.\n"
+		  "    Activate with it directly and skip the keyslot KDF.\n");
+	info_cont("  --nv:\n"
+		  "    (optional) Read the passphrase stored in the NV\n"
+		  "    index by seal --nv.\n");
+	info_cont("  --blob <file>:\n"
+		  "    (optional) Load the passphrase object from the hex\n"
+		  "    string exported by seal --blob. By default, the blob\n"
+		  "    in the luks-setup-unsealing token of the LUKS2 device\n"
+		  "    is used if any.\n");
+}
+
+#define EXTRA_OPT_BASE			0x8400
+#define EXTRA_OPT_VOLUME_KEY		(EXTRA_OPT_BASE + 0)
+#define EXTRA_OPT_NV			(EXTRA_OPT_BASE + 1)
+#define EXTRA_OPT_BLOB			(EXTRA_OPT_BASE + 2)
+
+/* The number of tokens in LUKS2 header */
+#define LUKS2_TOKENS_MAX		32
+
+#define TOKEN_TYPE_PREFIX		"luks-setup-unsealing"
+
+static int
+parse_arg(int opt, char *optarg)
+{
+	switch (opt) {
+	case 1:
+		if (!opt_device)
+			opt_device = optarg;
+		else if (!opt_name)
+			opt_name = optarg;
+		else {
+			err("Unrecognized argument %s\n", optarg);
+			return -1;
+		}
+		break;
+	case 'k':
+		{
+			char *end;
+
+			opt_key_slot = strtol(optarg, &end, 0);
+			if (*end || opt_key_slot < 0) {
+				err("Invalid keyslot %s\n", optarg);
+				return -1;
+			}
+			break;
+		}
+	case 'r':
+		opt_readonly = true;
+		break;
+	case EXTRA_OPT_VOLUME_KEY:
+		opt_volume_key = true;
+		break;
+	case EXTRA_OPT_NV:
+		option_nv = true;
+		break;
+	case EXTRA_OPT_BLOB:
+		opt_blob = optarg;
+		break;
+	case 'P':
+		if (!strcasecmp(optarg, "sha1"))
+			opt_pcr_bank_alg = TPM2_ALG_SHA1;
+		else if (!strcasecmp(optarg, "sha256"))
+			opt_pcr_bank_alg = TPM2_ALG_SHA256;
+		else if (!strcasecmp(optarg, "sha384"))
+			opt_pcr_bank_alg = TPM2_ALG_SHA384;
+		else if (!strcasecmp(optarg, "sha512"))
+			opt_pcr_bank_alg = TPM2_ALG_SHA512;
+		else if (!strcasecmp(optarg, "sm3_256"))
+			opt_pcr_bank_alg = TPM2_ALG_SM3_256;
+		else if (!strcasecmp(optarg, "auto"))
+			opt_pcr_bank_alg = TPM2_ALG_AUTO;
+		else {
+			err("Unrecognized PCR bank algorithm\n");
+			return -1;
+		}
+
+		break;
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+open_log_cb(int level, const char *msg, void *usrptr)
+{
+	if (level == CRYPT_LOG_ERROR)
+		err("libcryptsetup: %s", msg);
+	else
+		dbg("libcryptsetup: %s", msg);
+}
+
+static int
+load_luks(const char *device, struct crypt_device **out)
+{
+	struct crypt_device *cd;
+	int rc;
+
+	crypt_set_log_callback(NULL, open_log_cb, NULL);
+
+	rc = crypt_init(&cd, device);
+	if (rc < 0) {
+		err("Unable to initialize the crypt device %s (%s)\n",
+		    device, strerror(-rc));
+		return -1;
+	}
+
+	rc = crypt_load(cd, CRYPT_LUKS, NULL);
+	if (rc < 0) {
+		err("Unable to load the LUKS header from %s (%s)\n",
+		    device, strerror(-rc));
+		crypt_free(cd);
+		return -1;
+	}
+
+	*out = cd;
+
+	return 0;
+}
+
+/*
+ * Look for the hex string of the blob in the token enrolled by
+ * luks-setup. The token is flat json written by luks-setup so a full
+ * json parser is not required.
+ */
+static int
+get_token_blob(struct crypt_device *cd, char **hex, unsigned long *hex_size)
+{
+	for (int id = 0; id < LUKS2_TOKENS_MAX; ++id) {
+		const char *type;
+		const char *json;
+		crypt_token_info status;
+
+		status = crypt_token_status(cd, id, &type);
+		if (status == CRYPT_TOKEN_INVALID ||
+		    status == CRYPT_TOKEN_INACTIVE)
+			continue;
+
+		if (!type || strncmp(type, TOKEN_TYPE_PREFIX,
+				     sizeof(TOKEN_TYPE_PREFIX) - 1))
+			continue;
+
+		if (crypt_token_json_get(cd, id, &json) < 0)
+			continue;
+
+		const char *p = strstr(json, "\"blob\"");
+		if (!p)
+			continue;
+
+		p += strlen("\"blob\"");
+		p += strspn(p, " \t\n");
+		if (*p++ != ':')
+			continue;
+		p += strspn(p, " \t\n");
+		if (*p++ != '"')
+			continue;
+
+		size_t len = strspn(p, "0123456789abcdefABCDEF");
+		if (!len || p[len] != '"')
+			continue;
+
+		*hex = strndup(p, len);
+		if (!*hex)
+			return -1;
+
+		*hex_size = len;
+
+		dbg("Found the blob in the token %d\n", id);
+
+		return 0;
+	}
+
+	return -1;
+}
+
+static int
+unseal_blob(char *hex, unsigned long hex_size, void **passphrase,
+	    size_t *passphrase_size)
+{
+	uint8_t *blob;
+	unsigned long blob_size;
+
+	int rc = cryptfs_tpm2_util_hex_decode(hex, hex_size, &blob,
+					      &blob_size);
+	if (rc)
+		return rc;
+
+	rc = cryptfs_tpm2_unseal_passphrase_blob(opt_pcr_bank_alg, blob,
+						 blob_size, passphrase,
+						 passphrase_size);
+	free(blob);
+
+	return rc;
+}
+
+static int
+activate_luks(struct crypt_device *cd, const char *device, const char *name,
+	      int key_slot, const char *passphrase, size_t passphrase_size)
+{
+	int rc;
+	uint32_t flags = opt_readonly == true ? CRYPT_ACTIVATE_READONLY : 0;
+
+	if (opt_volume_key == true)
+		rc = crypt_activate_by_volume_key(cd, name, passphrase,
+						  passphrase_size, flags);
+	else
+		rc = crypt_activate_by_passphrase(cd, name, key_slot,
+						  passphrase, passphrase_size,
+						  flags);
+	if (rc < 0) {
+		err("Unable to activate %s as %s (%s)\n", device, name,
+		    strerror(-rc));
+		return -1;
+	}
+
+	if (opt_volume_key == false)
+		dbg("%s is activated with keyslot %d\n", device, rc);
+
+	return 0;
+}
+
+static int
+run_open(char *prog)
+{
+	if (!opt_device || !opt_name) {
+		show_usage(prog);
+		return -1;
+	}
+
+	if (opt_blob && option_nv == true) {
+		err("--blob cannot be used with --nv\n");
+		return -1;
+	}
+
+	if (opt_pcr_bank_alg != TPM2_ALG_NULL &&
+	    cryptfs_tpm2_capability_pcr_bank_supported(&opt_pcr_bank_alg) == false) {
+		err("Unsupported PCR bank algorithm\n");
+		return -1;
+	}
+
+	struct crypt_device *cd;
+	int rc;
+
+	rc = load_luks(opt_device, &cd);
+	if (rc)
+		return rc;
+
+	char *hex = NULL;
+	unsigned long hex_size;
+
+	if (opt_blob) {
+		if (cryptfs_tpm2_util_load_file(opt_blob, (uint8_t **)&hex,
+						&hex_size)) {
+			err("Unable to load the blob from %s\n", opt_blob);
+			crypt_free(cd);
+			return -1;
+		}
+	} else if (option_nv == false)
+		get_token_blob(cd, &hex, &hex_size);
+
+	void *passphrase;
+	size_t passphrase_size;
+
+	if (hex) {
+		rc = unseal_blob(hex, hex_size, &passphrase, &passphrase_size);
+		free(hex);
+	} else
+		rc = cryptfs_tpm2_unseal_passphrase(opt_pcr_bank_alg,
+						    &passphrase,
+						    &passphrase_size);
+	if (rc) {
+		crypt_free(cd);
+		return rc;
+	}
+
+	/* The unsealed passphrase is passed to libcryptsetup as is */
+	rc = activate_luks(cd, opt_device, opt_name, opt_key_slot, passphrase,
+			   passphrase_size);
+	crypt_free(cd);
+
+	memset(passphrase, 0, passphrase_size);
+	free(passphrase);
+
+	if (!rc)
+		info("%s is opened as /dev/mapper/%s\n", opt_device, opt_name);
+
+	return rc;
+}
+
+static struct option long_opts[] = {
+	{ "pcr-bank-alg", required_argument, NULL, 'P' },
+	{ "key-slot", required_argument, NULL, 'k' },
+	{ "readonly", no_argument, NULL, 'r' },
+	{ "volume-key", no_argument, NULL, EXTRA_OPT_VOLUME_KEY },
+	{ "nv", no_argument, NULL, EXTRA_OPT_NV },
+	{ "blob", required_argument, NULL, EXTRA_OPT_BLOB },
+	{ 0 },	/* NULL terminated */
+};
+
+subcommand_t subcommand_open = {
+	.name = "open",
+	.optstring = "-P:k:r",
+	.long_opts = long_opts,
+	.parse_arg = parse_arg,
+	.show_usage = show_usage,
+	.run = run_open,
+};
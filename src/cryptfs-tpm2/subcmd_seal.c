@@ -36,8 +36,13 @@
 
 static bool opt_setup_key;
 static bool opt_setup_passphrase;
+static bool opt_volume_key;
 static char *opt_passphrase;
 static TPMI_ALG_HASH opt_pcr_bank_alg = TPM2_ALG_NULL;
+static char *opt_agent;
+static TPMI_ALG_PUBLIC opt_key_type = TPM2_ALG_NULL;
+static cryptfs_tpm2_parent_t opt_parent = CRYPTFS_TPM2_PARENT_KEY;
+static char *opt_blob;
 
 static void
 show_usage(char *prog)
@@ -46,6 +51,8 @@ show_usage(char *prog)
 	info_cont("\nobject:\n");
 	info_cont("  The object to be sealed. The allowed values are:\n"
 		  "  - passphrase: Passphrase used to encrypt LUKS\n"
+		  "  - volume-key: LUKS volume key specified with -p,\n"
+		  "    sealed in place of the passphrase\n"
 		  "  - key: Primary key used to seal the passphrase\n"
 		  "  - all: All above\n");
 	info_cont("\nargs:\n");
@@ -54,16 +61,54 @@ show_usage(char *prog)
 		  "    created primary key and passphrase.\n");
 	info_cont("  --passphrase, -p:\n"
 		  "    (optional) Explicitly set the passphrase value\n"
-		  "    (32-byte at most) instead of the one generated\n"
+		  "    (64-byte at most) instead of the one generated\n"
 		  "    by TPM randomly. This parameter allows to be\n"
-		  "    specified as a file path.\n");
+		  "    specified as a file path. For volume-key, it must\n"
+		  "    be a file holding the volume key (128-byte at most).\n");
 	info_cont("  --no-da:\n"
 		  "    (optional) The authorization failure never cause\n"
 		  "    DA lockout\n");
+	info_cont("  --check-policy:\n"
+		  "    (optional) Cross-check the policy digest calculated\n"
+		  "    on the host with the one from a TPM trial session\n");
+	info_cont("  --agent <socket>:\n"
+		  "    (optional) Request the running cryptfs-tpm2 agent\n"
+		  "    listening on the socket to seal\n");
+	info_cont("  --key-type <ecc|rsa>:\n"
+		  "    (optional) The type of primary key. ECC NIST P-256\n"
+		  "    is much faster to create than RSA 2048-bit.\n"
+		  "    Default: ecc if supported by TPM, otherwise rsa\n");
+	info_cont("  --parent <key|srk|auto>:\n"
+		  "    (optional) The parent of the passphrase. srk reuses\n"
+		  "    the TCG storage root key at %#8.8x, so the primary\n"
+		  "    key is not created at all. auto uses the SRK if\n"
+		  "    compatible, otherwise the primary key.\n"
+		  "    Default: key\n", CRYPTFS_TPM2_SRK_HANDLE);
+	info_cont("  --no-create-loaded:\n"
+		  "    (optional) Always create and load the passphrase\n"
+		  "    object in two steps even if TPM2_CreateLoaded is\n"
+		  "    supported by TPM\n");
+	info_cont("  --nv:\n"
+		  "    (optional) Store the passphrase in the NV index\n"
+		  "    %#8.8x instead of sealing it under the primary key.\n"
+		  "    The primary key is not needed at all.\n",
+		  CRYPTFS_TPM2_NV_INDEX);
+	info_cont("  --blob <file>:\n"
+		  "    (optional) Export the sealed passphrase object to\n"
+		  "    the file as a hex string instead of persisting it\n"
+		  "    in TPM. No persistent handle is consumed, and the\n"
+		  "    blob is unsealed with \"unseal --blob\".\n");
 }
 
 #define EXTRA_OPT_BASE			0x8100
 #define EXTRA_OPT_NO_DA			(EXTRA_OPT_BASE + 0)
+#define EXTRA_OPT_CHECK_POLICY		(EXTRA_OPT_BASE + 1)
+#define EXTRA_OPT_AGENT			(EXTRA_OPT_BASE + 2)
+#define EXTRA_OPT_KEY_TYPE		(EXTRA_OPT_BASE + 3)
+#define EXTRA_OPT_PARENT		(EXTRA_OPT_BASE + 4)
+#define EXTRA_OPT_NO_CREATE_LOADED	(EXTRA_OPT_BASE + 5)
+#define EXTRA_OPT_NV			(EXTRA_OPT_BASE + 6)
+#define EXTRA_OPT_BLOB			(EXTRA_OPT_BASE + 7)
 
 static int
 parse_arg(int opt, char *optarg)
@@ -90,21 +135,58 @@ parse_arg(int opt, char *optarg)
 			return -1;
 		}
 
-		if (cryptfs_tpm2_capability_pcr_bank_supported(&opt_pcr_bank_alg) == false) {
-			err("Unsupported PCR bank algorithm\n");
+		break;
+	case EXTRA_OPT_NO_DA:
+		option_no_da = true;
+		break;
+	case EXTRA_OPT_CHECK_POLICY:
+		option_check_policy = true;
+		break;
+	case EXTRA_OPT_AGENT:
+		opt_agent = optarg;
+		break;
+	case EXTRA_OPT_KEY_TYPE:
+		if (!strcasecmp(optarg, "ecc"))
+			opt_key_type = TPM2_ALG_ECC;
+		else if (!strcasecmp(optarg, "rsa"))
+			opt_key_type = TPM2_ALG_RSA;
+		else {
+			err("Unrecognized primary key type\n");
 			return -1;
 		}
 
 		break;
-	case EXTRA_OPT_NO_DA:
-		option_no_da = true;
+	case EXTRA_OPT_PARENT:
+		if (!strcasecmp(optarg, "key"))
+			opt_parent = CRYPTFS_TPM2_PARENT_KEY;
+		else if (!strcasecmp(optarg, "srk"))
+			opt_parent = CRYPTFS_TPM2_PARENT_SRK;
+		else if (!strcasecmp(optarg, "auto"))
+			opt_parent = CRYPTFS_TPM2_PARENT_AUTO;
+		else {
+			err("Unrecognized parent\n");
+			return -1;
+		}
+
+		break;
+	case EXTRA_OPT_NO_CREATE_LOADED:
+		option_no_create_loaded = true;
+		break;
+	case EXTRA_OPT_NV:
+		option_nv = true;
+		break;
+	case EXTRA_OPT_BLOB:
+		opt_blob = optarg;
 		break;
 	case 1:
 		if (!strcasecmp(optarg, "key"))
 			opt_setup_key = 1;
 		else if (!strcasecmp(optarg, "passphrase"))
 			opt_setup_passphrase = 1;
-		else if (!strcasecmp(optarg, "all")) {
+		else if (!strcasecmp(optarg, "volume-key")) {
+			opt_setup_passphrase = 1;
+			opt_volume_key = 1;
+		} else if (!strcasecmp(optarg, "all")) {
 			opt_setup_key = 1;
 			opt_setup_passphrase = 1;
 		} else {
@@ -125,36 +207,167 @@ parse_arg(int opt, char *optarg)
 	return 0;
 }
 
+static int
+seal_by_agent(char *passphrase, size_t passphrase_size)
+{
+	struct {
+		cryptfs_tpm2_agent_request_t req;
+		char passphrase[CRYPTFS_TPM2_VOLUME_KEY_MAX_SIZE];
+	} __attribute__((packed)) msg = {
+		.req = {
+			.pcr_bank_alg = opt_pcr_bank_alg,
+		},
+	};
+
+	if (opt_setup_key)
+		msg.req.objects |= CRYPTFS_TPM2_AGENT_OBJECT_KEY;
+	if (opt_setup_passphrase)
+		msg.req.objects |= CRYPTFS_TPM2_AGENT_OBJECT_PASSPHRASE;
+	if (opt_volume_key)
+		msg.req.objects |= CRYPTFS_TPM2_AGENT_OBJECT_VOLUME_KEY;
+	if (option_nv == true)
+		msg.req.objects |= CRYPTFS_TPM2_AGENT_OBJECT_NV;
+	if (option_no_da == true)
+		msg.req.flags |= CRYPTFS_TPM2_AGENT_FLAG_NO_DA;
+	if (option_check_policy == true)
+		msg.req.flags |= CRYPTFS_TPM2_AGENT_FLAG_CHECK_POLICY;
+	if (opt_key_type == TPM2_ALG_RSA)
+		msg.req.flags |= CRYPTFS_TPM2_AGENT_FLAG_KEY_RSA;
+	else if (opt_key_type == TPM2_ALG_ECC)
+		msg.req.flags |= CRYPTFS_TPM2_AGENT_FLAG_KEY_ECC;
+	if (opt_parent == CRYPTFS_TPM2_PARENT_SRK)
+		msg.req.flags |= CRYPTFS_TPM2_AGENT_FLAG_PARENT_SRK;
+	else if (opt_parent == CRYPTFS_TPM2_PARENT_AUTO)
+		msg.req.flags |= CRYPTFS_TPM2_AGENT_FLAG_PARENT_AUTO;
+	if (option_no_create_loaded == true)
+		msg.req.flags |= CRYPTFS_TPM2_AGENT_FLAG_NO_CREATE_LOADED;
+
+	if (passphrase_size)
+		memcpy(msg.passphrase, passphrase, passphrase_size);
+
+	/* The PCR bank is resolved by the agent */
+	int rc = cryptfs_tpm2_agent_call(opt_agent, CRYPTFS_TPM2_AGENT_SEAL,
+					 &msg, sizeof(msg.req) +
+					 passphrase_size, NULL, NULL);
+	memset(&msg, 0, sizeof(msg));
+	if (rc)
+		err("Unable to seal by the agent\n");
+
+	return rc;
+}
+
+static int
+seal_blob(char *passphrase, size_t passphrase_size, TPMI_DH_OBJECT parent)
+{
+	void *blob;
+	size_t blob_size;
+
+	int rc = cryptfs_tpm2_create_passphrase_blob(passphrase,
+						     passphrase_size,
+						     opt_pcr_bank_alg, parent,
+						     &blob, &blob_size);
+	if (rc)
+		return rc;
+
+	char *hex;
+
+	rc = cryptfs_tpm2_util_hex_encode(blob, blob_size, &hex);
+	free(blob);
+	if (rc)
+		return rc;
+
+	rc = cryptfs_tpm2_util_save_output_file(opt_blob, (uint8_t *)hex,
+						strlen(hex));
+	free(hex);
+	if (rc)
+		err("Unable to save the blob to %s\n", opt_blob);
+
+	return rc;
+}
+
 static int
 run_seal(char *prog)
 {
 	int rc = 0;
+	size_t size = 0;
 
-	if (opt_setup_key) {
-		rc = cryptfs_tpm2_create_primary_key(opt_pcr_bank_alg);
-		if (rc)
-			return rc;
+	if (opt_volume_key && !opt_passphrase) {
+		err("The volume key must be specified with -p\n");
+		return -1;
 	}
 
-	if (opt_setup_passphrase) {
-		size_t size;
+	if (opt_setup_passphrase && opt_passphrase) {
+		rc = cryptfs_tpm2_util_load_file(opt_passphrase,
+						 (uint8_t **)&opt_passphrase,
+						 (unsigned long *)&size);
+		if (rc) {
+			if (opt_volume_key) {
+				err("Unable to load the volume key\n");
+				return -1;
+			}
 
-		if (opt_passphrase) {
-			rc = cryptfs_tpm2_util_load_file(opt_passphrase,
-							 (uint8_t **)&opt_passphrase,
-							 (unsigned long *)&size);
-			if (rc)
-				size = strlen(opt_passphrase);
-		} else
-			size = 0;
+			size = strlen(opt_passphrase);
+		}
 
-		if (size > CRYPTFS_TPM2_PASSPHRASE_MAX_SIZE) {
+		/*
+		 * The volume key is not fed to PBKDF so it is only limited
+		 * by the size of sealed data object.
+		 */
+		if (size > (opt_volume_key ? CRYPTFS_TPM2_VOLUME_KEY_MAX_SIZE :
+			    CRYPTFS_TPM2_PASSPHRASE_MAX_SIZE)) {
 			err("The passphrase explicitly specified is too long\n");
 			return -1;
 		}
+	}
+
+	if (opt_blob) {
+		if (!opt_setup_passphrase) {
+			err("--blob requires to seal the passphrase\n");
+			return -1;
+		}
+
+		if (opt_agent || option_nv == true) {
+			err("--blob cannot be used with --agent or --nv\n");
+			return -1;
+		}
+	}
+
+	if (opt_agent)
+		return seal_by_agent(opt_passphrase, size);
+
+	if (opt_pcr_bank_alg != TPM2_ALG_NULL &&
+	    cryptfs_tpm2_capability_pcr_bank_supported(&opt_pcr_bank_alg) == false) {
+		err("Unsupported PCR bank algorithm\n");
+		return -1;
+	}
+
+	TPMI_DH_OBJECT parent = CRYPTFS_TPM2_PRIMARY_KEY_HANDLE;
+
+	if (option_nv == false &&
+	    cryptfs_tpm2_select_parent(opt_parent, &parent))
+		return -1;
+
+	if (opt_setup_key) {
+		if (option_nv == true)
+			info("Skip creating the primary key which is not "
+			     "used by the NV index\n");
+		else if (parent == CRYPTFS_TPM2_SRK_HANDLE)
+			info("Skip creating the primary key in favor of "
+			     "the SRK\n");
+		else {
+			rc = cryptfs_tpm2_create_primary_key(opt_pcr_bank_alg,
+							     opt_key_type);
+			if (rc)
+				return rc;
+		}
+	}
+
+	if (opt_setup_passphrase) {
+		if (opt_blob)
+			return seal_blob(opt_passphrase, size, parent);
 
 		rc = cryptfs_tpm2_create_passphrase(opt_passphrase, size,
-						    opt_pcr_bank_alg);
+						    opt_pcr_bank_alg, parent);
 		if (rc)
 			return rc;
 	}
@@ -166,6 +379,13 @@ static struct option long_opts[] = {
 	{ "passphrase", required_argument, NULL, 'p' },
 	{ "pcr-bank-alg", required_argument, NULL, 'P' },
 	{ "no-da", no_argument, NULL, EXTRA_OPT_NO_DA },
+	{ "check-policy", no_argument, NULL, EXTRA_OPT_CHECK_POLICY },
+	{ "agent", required_argument, NULL, EXTRA_OPT_AGENT },
+	{ "key-type", required_argument, NULL, EXTRA_OPT_KEY_TYPE },
+	{ "parent", required_argument, NULL, EXTRA_OPT_PARENT },
+	{ "no-create-loaded", no_argument, NULL, EXTRA_OPT_NO_CREATE_LOADED },
+	{ "nv", no_argument, NULL, EXTRA_OPT_NV },
+	{ "blob", required_argument, NULL, EXTRA_OPT_BLOB },
 	{ 0 },	/* NULL terminated */
 };
 
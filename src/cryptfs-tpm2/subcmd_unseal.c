@@ -37,6 +37,9 @@
 static bool opt_unseal_passphrase;
 static char *opt_output_file;
 static TPMI_ALG_HASH opt_pcr_bank_alg = TPM2_ALG_NULL;
+static char *opt_agent;
+static char *opt_exec;
+static char *opt_blob;
 
 static void
 show_usage(char *prog)
@@ -44,22 +47,56 @@ show_usage(char *prog)
 	info_cont("\nUsage: %s <options> unseal <object>\n", prog);
 	info_cont("\nobject:\n");
 	info_cont("  The object to be unsealed. The allowed values are:\n"
-		  "  - passphrase: Passphrase used to encrypt LUKS\n");
+		  "  - passphrase: Passphrase used to encrypt LUKS\n"
+		  "  - volume-key: LUKS volume key sealed in place of\n"
+		  "    the passphrase\n");
 	info_cont("\nargs:\n");
+	info_cont("  --output, -o:\n"
+		  "    (optional) Write the unsealed object to the specified\n"
+		  "    file. Specify - to write the raw bytes to stdout.\n");
 	info_cont("  --pcr-bank-alg, -P:\n"
 		  "    (optional) Use the specified PCR bank to bind the\n"
 		  "    created primary key and passphrase.\n");
 	info_cont("  --lockoutauth, -l:\n"
 		  "    (optional) Specify the authorization value for\n"
 		  "    lockout.\n");
+	info_cont("  --pcr-digest:\n"
+		  "    (optional) Read the PCRs and pass their digest to\n"
+		  "    PolicyPCR, instead of letting TPM evaluate PolicyPCR\n"
+		  "    with the current PCRs.\n");
+	info_cont("  --agent <socket>:\n"
+		  "    (optional) Request the running cryptfs-tpm2 agent\n"
+		  "    listening on the socket to unseal.\n");
+	info_cont("  --exec <command>:\n"
+		  "    (optional) Run the command with /bin/sh and pass the\n"
+		  "    unsealed object through its stdin, e.g,\n"
+		  "    \"cryptsetup luksOpen --key-file - <dev> <name>\".\n"
+		  "    The same data is also readable from the file\n"
+		  "    /proc/self/fd/$CRYPTFS_TPM2_KEY_FD. The exit status\n"
+		  "    of the command is returned.\n");
+	info_cont("  --nv:\n"
+		  "    (optional) Read the passphrase stored in the NV\n"
+		  "    index by seal --nv.\n");
+	info_cont("  --blob <file>:\n"
+		  "    (optional) Load the passphrase object from the hex\n"
+		  "    string exported by seal --blob, and flush it once\n"
+		  "    unsealed.\n");
 }
 
+#define EXTRA_OPT_BASE			0x8200
+#define EXTRA_OPT_PCR_DIGEST		(EXTRA_OPT_BASE + 0)
+#define EXTRA_OPT_AGENT			(EXTRA_OPT_BASE + 1)
+#define EXTRA_OPT_EXEC			(EXTRA_OPT_BASE + 2)
+#define EXTRA_OPT_NV			(EXTRA_OPT_BASE + 3)
+#define EXTRA_OPT_BLOB			(EXTRA_OPT_BASE + 4)
+
 static int
 parse_arg(int opt, char *optarg)
 {
 	switch (opt) {
 	case 1:
-		if (!strcasecmp(optarg, "passphrase"))
+		if (!strcasecmp(optarg, "passphrase") ||
+		    !strcasecmp(optarg, "volume-key"))
 			opt_unseal_passphrase = 1;
 		else {
 			err("Unrecognized value\n");
@@ -87,11 +124,21 @@ parse_arg(int opt, char *optarg)
 			return -1;
 		}
 
-		if (cryptfs_tpm2_capability_pcr_bank_supported(&opt_pcr_bank_alg) == false) {
-			err("Unsupported PCR bank algorithm\n");
-			return -1;
-		}
-
+		break;
+	case EXTRA_OPT_PCR_DIGEST:
+		option_pcr_digest = true;
+		break;
+	case EXTRA_OPT_AGENT:
+		opt_agent = optarg;
+		break;
+	case EXTRA_OPT_EXEC:
+		opt_exec = optarg;
+		break;
+	case EXTRA_OPT_NV:
+		option_nv = true;
+		break;
+	case EXTRA_OPT_BLOB:
+		opt_blob = optarg;
 		break;
 	default:
 		return -1;
@@ -100,22 +147,125 @@ parse_arg(int opt, char *optarg)
 	return 0;
 }
 
+static int
+unseal_blob(unsigned char **passphrase, size_t *passphrase_size)
+{
+	char *hex;
+	unsigned long hex_size;
+
+	if (cryptfs_tpm2_util_load_file(opt_blob, (uint8_t **)&hex,
+					&hex_size)) {
+		err("Unable to load the blob from %s\n", opt_blob);
+		return -1;
+	}
+
+	uint8_t *blob;
+	unsigned long blob_size;
+
+	int rc = cryptfs_tpm2_util_hex_decode(hex, hex_size, &blob,
+					      &blob_size);
+	free(hex);
+	if (rc)
+		return rc;
+
+	rc = cryptfs_tpm2_unseal_passphrase_blob(opt_pcr_bank_alg, blob,
+						 blob_size,
+						 (void **)passphrase,
+						 passphrase_size);
+	free(blob);
+
+	return rc;
+}
+
 static int
 run_unseal(char *prog)
 {
 	int rc = 0;
+	int output_fd = -1;
+
+	if (opt_output_file && opt_exec) {
+		err("--output and --exec are mutually exclusive\n");
+		return -1;
+	}
+
+	if (opt_blob && (opt_agent || option_nv == true)) {
+		err("--blob cannot be used with --agent or --nv\n");
+		return -1;
+	}
+
+	if (opt_output_file && !strcmp(opt_output_file, "-")) {
+		/*
+		 * Keep stdout exclusively for the raw output and send any
+		 * message to stderr instead.
+		 */
+		fflush(stdout);
+
+		output_fd = dup(STDOUT_FILENO);
+		if (output_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+			err("Unable to redirect stdout\n");
+			return -1;
+		}
+	}
 
 	if (opt_unseal_passphrase) {
 		unsigned char *passphrase;
 		size_t passphrase_size;
 
-		rc = cryptfs_tpm2_unseal_passphrase(opt_pcr_bank_alg,
-						    (void **)&passphrase,
-						    &passphrase_size);
-		if (rc)
-			return rc;
+		if (opt_agent) {
+			cryptfs_tpm2_agent_request_t req = {
+				.pcr_bank_alg = opt_pcr_bank_alg,
+			};
+			if (option_pcr_digest == true)
+				req.flags |= CRYPTFS_TPM2_AGENT_FLAG_PCR_DIGEST;
+			if (option_nv == true)
+				req.objects |= CRYPTFS_TPM2_AGENT_OBJECT_NV;
+
+			uint32_t size;
+
+			/* The PCR bank is resolved by the agent */
+			rc = cryptfs_tpm2_agent_call(opt_agent,
+						     CRYPTFS_TPM2_AGENT_UNSEAL,
+						     &req, sizeof(req),
+						     &passphrase, &size);
+			if (rc) {
+				err("Unable to unseal the passphrase by "
+				    "the agent\n");
+				return rc;
+			}
+
+			passphrase_size = size;
+		} else {
+			if (opt_pcr_bank_alg != TPM2_ALG_NULL &&
+			    cryptfs_tpm2_capability_pcr_bank_supported(&opt_pcr_bank_alg) == false) {
+				err("Unsupported PCR bank algorithm\n");
+				return -1;
+			}
 
-		if (!opt_output_file) {
+			if (opt_blob)
+				rc = unseal_blob(&passphrase,
+						 &passphrase_size);
+			else
+				rc = cryptfs_tpm2_unseal_passphrase(opt_pcr_bank_alg,
+								    (void **)&passphrase,
+								    &passphrase_size);
+			if (rc)
+				return rc;
+		}
+
+		if (opt_exec) {
+			/*
+			 * The command may use TPM too, e.g, to unseal
+			 * another blob, and /dev/tpm0 is exclusive.
+			 */
+			cryptfs_tpm2_teardown();
+
+			rc = cryptfs_tpm2_util_exec_with_input(opt_exec,
+							       passphrase,
+							       passphrase_size);
+		} else if (output_fd >= 0)
+			rc = cryptfs_tpm2_util_write_fd(output_fd, passphrase,
+							passphrase_size);
+		else if (!opt_output_file) {
 			info("Dumping the passphrase (%Zd-byte):\n",
 			     passphrase_size);
 
@@ -126,8 +276,13 @@ run_unseal(char *prog)
 			rc = cryptfs_tpm2_util_save_output_file(opt_output_file,
 								passphrase,
 								passphrase_size);
+
+		memset(passphrase, 0, passphrase_size);
 	}
 
+	if (output_fd >= 0)
+		close(output_fd);
+
 	return rc;
 }
 
@@ -135,6 +290,11 @@ static struct option long_opts[] = {
 	{ "output", required_argument, NULL, 'o' },
 	{ "pcr-bank-alg", required_argument, NULL, 'P' },
 	{ "lockoutauth", optional_argument, NULL, 'l' },
+	{ "pcr-digest", no_argument, NULL, EXTRA_OPT_PCR_DIGEST },
+	{ "agent", required_argument, NULL, EXTRA_OPT_AGENT },
+	{ "exec", required_argument, NULL, EXTRA_OPT_EXEC },
+	{ "nv", no_argument, NULL, EXTRA_OPT_NV },
+	{ "blob", required_argument, NULL, EXTRA_OPT_BLOB },
 	{ 0 },	/* NULL terminated */
 };
 
@@ -58,7 +58,14 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <endian.h>
 #include <linux/limits.h>
+#include <linux/memfd.h>
+#include <linux/netlink.h>
 
 #include <subcommand.h>
 
@@ -100,6 +107,14 @@
 #define TPM2_RC_FMT1                            RC_FMT1
 #define TPM2_RC_BAD_AUTH                        TPM_RC_BAD_AUTH
 #define TPM2_RC_AUTH_FAIL                       TPM_RC_AUTH_FAIL
+#define TPM2_RC_HANDLE                          TPM_RC_HANDLE
+#define TPM2_RC_OBJECT_MEMORY                   TPM_RC_OBJECT_MEMORY
+#define TPM2_RC_SESSION_MEMORY                  TPM_RC_SESSION_MEMORY
+#define TPM2_RC_OBJECT_HANDLES                  TPM_RC_OBJECT_HANDLES
+#define TPM2_RC_SESSION_HANDLES                 TPM_RC_SESSION_HANDLES
+#define TPM2_RC_NV_DEFINED                      TPM_RC_NV_DEFINED
+#define TPM2_RC_SIZE                            TPM_RC_SIZE
+#define TPM2_RC_VALUE                           TPM_RC_VALUE
 
 #define TPM2_ALG_RSA                            TPM_ALG_RSA
 #define TPM2_ALG_HMAC                           TPM_ALG_HMAC
@@ -141,6 +156,7 @@
 #define TPM2_SM3_256_DIGEST_SIZE                SM3_256_DIGEST_SIZE
 
 #define TPM2_ECC_NIST_P256                      TPM_ECC_NIST_P256
+#define TPM2_ECC_NONE                           TPM_ECC_NONE
 
 #define TPM2_PCR_SELECT_MAX                     PCR_SELECT_MAX
 
@@ -149,21 +165,30 @@
 #define TPM2_CAP_ALGS                           TPM_CAP_ALGS
 #define TPM2_CAP_PCRS                           TPM_CAP_PCRS
 #define TPM2_CAP_TPM_PROPERTIES                 TPM_CAP_TPM_PROPERTIES
+#define TPM2_CAP_ECC_CURVES                     TPM_CAP_ECC_CURVES
+#define TPM2_CAP_COMMANDS                       TPM_CAP_COMMANDS
 
 #define TPM2_PT                                 TPM_PT
 #define TPM2_PT_NONE                            TPM_PT_NONE
+#define TPM2_PT_MANUFACTURER                    TPM_PT_MANUFACTURER
 #define TPM2_PT_HR_PERSISTENT                   TPM_PT_HR_PERSISTENT
 #define TPM2_PT_LOCKOUT_INTERVAL                TPM_PT_LOCKOUT_INTERVAL
 #define TPM2_PT_LOCKOUT_COUNTER                 TPM_PT_LOCKOUT_COUNTER
 #define TPM2_PT_MAX_AUTH_FAIL                   TPM_PT_MAX_AUTH_FAIL
 #define TPM2_PT_LOCKOUT_RECOVERY                TPM_PT_LOCKOUT_RECOVERY
 #define TPM2_PT_PERMANENT                       TPM_PT_PERMANENT
+#define TPM2_MAX_TPM_PROPERTIES                 MAX_TPM_PROPERTIES
+#define TPM2_MAX_ECC_CURVES                     MAX_ECC_CURVES
 
 #define TPM2_SE                                 TPM_SE
 #define TPM2_SE_TRIAL                           TPM_SE_TRIAL
 #define TPM2_SE_POLICY                          TPM_SE_POLICY
 
 #define TPM2_HT_PERSISTENT                      TPM_HT_PERSISTENT
+#define TPM2_HT_TRANSIENT                       TPM_HT_TRANSIENT
+#define TPM2_HT_HMAC_SESSION                    TPM_HT_HMAC_SESSION
+#define TPM2_HT_POLICY_SESSION                  TPM_HT_POLICY_SESSION
+#define TPM2_HR_SHIFT                           HR_SHIFT
 
 #define TPM2_RH_OWNER                           TPM_RH_OWNER
 #define TPM2_RH_LOCKOUT                         TPM_RH_LOCKOUT
@@ -173,6 +198,10 @@
 
 #define TPM2_HANDLE                             TPM_HANDLE
 
+#define TPM2_CC_PolicyPCR                       TPM_CC_PolicyPCR
+#define TPM2_CC_PolicyAuthValue                 TPM_CC_PolicyAuthValue
+#define TPM2_CC_NV_WriteLock                    TPM_CC_NV_WriteLock
+
 #define TSS2_RC_LAYER_MASK                      TSS2_ERROR_LEVEL_MASK
 #endif
 
@@ -182,6 +211,12 @@
 /* The maximum length of passphrase explicitly specified */
 #define CRYPTFS_TPM2_PASSPHRASE_MAX_SIZE	64
 
+/*
+ * The maximum length of LUKS volume key sealed in place of the passphrase,
+ * i.e, MAX_SYM_DATA.
+ */
+#define CRYPTFS_TPM2_VOLUME_KEY_MAX_SIZE	128
+
 /* The maximum length of secret for hierarchy authentication */
 #define CRYPTFS_TPM2_SECRET_MAX_SIZE		256
 
@@ -191,13 +226,114 @@
 /* The persiste handle value for the passphrase */
 #define CRYPTFS_TPM2_PASSPHRASE_HANDLE		0x817FFFFE
 
+/* The persistent handle value for the TCG storage root key */
+#define CRYPTFS_TPM2_SRK_HANDLE			0x81000001
+
+/* The NV index holding the passphrase in place of the sealed object */
+#define CRYPTFS_TPM2_NV_INDEX			0x01BFFFFE
+
+/*
+ * The NV index has the fixed size so it is read in one TPM2_NV_Read
+ * without TPM2_NV_ReadPublic. The passphrase is prefixed with its size
+ * in 2-byte big-endian.
+ */
+#define CRYPTFS_TPM2_NV_SIZE			(2 + CRYPTFS_TPM2_VOLUME_KEY_MAX_SIZE)
+
+/* The parent of the passphrase object */
+typedef enum {
+	CRYPTFS_TPM2_PARENT_KEY,
+	CRYPTFS_TPM2_PARENT_SRK,
+	/* The SRK if compatible, otherwise the primary key */
+	CRYPTFS_TPM2_PARENT_AUTO,
+} cryptfs_tpm2_parent_t;
+
 /* The maximum atempts of prompting to type the lockout auth */
 #define CRYPTFS_TPM2_MAX_LOCKOUT_RETRY		3
 
+/* The default socket path of cryptfs-tpm2 agent */
+#define CRYPTFS_TPM2_AGENT_SOCKET		"/run/cryptfs-tpm2-agent.sock"
+
+/*
+ * The agent protocol. Each request and response begins with a header
+ * followed by the payload. All fields are in host byte order because
+ * the peers are always on the same host.
+ */
+#define CRYPTFS_TPM2_AGENT_MAGIC		0x41505443	/* "CTPA" */
+#define CRYPTFS_TPM2_AGENT_VERSION		1
+#define CRYPTFS_TPM2_AGENT_MAX_PAYLOAD		4096
+
+#define CRYPTFS_TPM2_AGENT_STATUS		0
+#define CRYPTFS_TPM2_AGENT_UNSEAL		1
+#define CRYPTFS_TPM2_AGENT_SEAL			2
+
+#define CRYPTFS_TPM2_AGENT_OBJECT_KEY		(1 << 0)
+#define CRYPTFS_TPM2_AGENT_OBJECT_PASSPHRASE	(1 << 1)
+/* The passphrase is stored in the NV index */
+#define CRYPTFS_TPM2_AGENT_OBJECT_NV		(1 << 2)
+/* The passphrase is the LUKS volume key, which is allowed to be longer */
+#define CRYPTFS_TPM2_AGENT_OBJECT_VOLUME_KEY	(1 << 3)
+
+#define CRYPTFS_TPM2_AGENT_FLAG_NO_DA		(1 << 0)
+#define CRYPTFS_TPM2_AGENT_FLAG_CHECK_POLICY	(1 << 1)
+#define CRYPTFS_TPM2_AGENT_FLAG_PCR_DIGEST	(1 << 2)
+/* Primary key type of SEAL request, or TPM preferred if neither is set */
+#define CRYPTFS_TPM2_AGENT_FLAG_KEY_RSA		(1 << 3)
+#define CRYPTFS_TPM2_AGENT_FLAG_KEY_ECC		(1 << 4)
+/* Parent of SEAL request, or the primary key if neither is set */
+#define CRYPTFS_TPM2_AGENT_FLAG_PARENT_SRK	(1 << 5)
+#define CRYPTFS_TPM2_AGENT_FLAG_PARENT_AUTO	(1 << 6)
+#define CRYPTFS_TPM2_AGENT_FLAG_NO_CREATE_LOADED	(1 << 7)
+
+typedef struct __attribute__((packed)) {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t command;
+	uint16_t reserved;
+	/* Only meaningful in response. 0 indicates success */
+	int32_t status;
+	uint32_t payload_size;
+} cryptfs_tpm2_agent_header_t;
+
+/* The payload of UNSEAL and SEAL requests, followed by the passphrase */
+typedef struct __attribute__((packed)) {
+	uint16_t pcr_bank_alg;
+	/* Only used by SEAL request, except CRYPTFS_TPM2_AGENT_OBJECT_NV */
+	uint8_t objects;
+	uint8_t flags;
+} cryptfs_tpm2_agent_request_t;
+
+/* The payload of STATUS response */
+typedef struct __attribute__((packed)) {
+	uint32_t pid;
+	uint32_t uptime;
+	uint32_t nr_request;
+	uint32_t nr_pending;
+	uint16_t pcr_bank_alg;
+	uint8_t in_lockout;
+	uint8_t reserved;
+} cryptfs_tpm2_agent_status_t;
+
 #define gettid()		syscall(__NR_gettid)
 
+/* The levels passed to the log handler */
+#define CRYPTFS_TPM2_LOG_FAULT		0
+#define CRYPTFS_TPM2_LOG_ERROR		1
+#define CRYPTFS_TPM2_LOG_WARNING	2
+#define CRYPTFS_TPM2_LOG_INFO		3
+#define CRYPTFS_TPM2_LOG_DEBUG		4
+
+typedef void (*cryptfs_tpm2_log_handler_t)(int level, const char *msg,
+					   void *data);
+
+extern bool
+cryptfs_tpm2_util_log(int level, const char *fmt, ...)
+	__attribute__ ((format(printf, 2, 3)));
+
 #define __pr__(level, io, fmt, ...)	\
 	do {	\
+		if (cryptfs_tpm2_util_log(CRYPTFS_TPM2_LOG_##level, fmt, \
+					  ##__VA_ARGS__) == true)	\
+			break;	\
 		time_t __t__ = time(NULL);	\
 		struct tm __loc__;	\
 		localtime_r(&__t__, &__loc__);	\
@@ -220,6 +356,9 @@
 
   #define dbg_cont(fmt, ...)	\
 	do {	\
+		if (cryptfs_tpm2_util_log(CRYPTFS_TPM2_LOG_DEBUG, fmt, \
+					  ##__VA_ARGS__) == true)	\
+			break;	\
 		fprintf(stdout, fmt, ##__VA_ARGS__);	\
 	} while (0)
 #else
@@ -251,6 +390,10 @@
 extern const char *cryptfs_tpm2_git_commit;
 extern int option_quite;
 extern bool option_no_da;
+extern bool option_check_policy;
+extern bool option_pcr_digest;
+extern bool option_no_create_loaded;
+extern bool option_nv;
 
 #define TPM2_ALG_AUTO		0x4000
 
@@ -260,6 +403,10 @@ cryptfs_tpm2_util_verbose(void);
 extern void
 cryptfs_tpm2_util_set_verbosity(int verbose);
 
+extern void
+cryptfs_tpm2_util_set_log_handler(cryptfs_tpm2_log_handler_t handler,
+				  void *data);
+
 extern char **
 cryptfs_tpm2_util_split_string(char *in, char *delim, unsigned int *nr);
 
@@ -281,6 +428,21 @@ extern int
 cryptfs_tpm2_util_save_output_file(const char *file_path, uint8_t *buf,
 				   unsigned long size);
 
+extern int
+cryptfs_tpm2_util_hex_encode(const uint8_t *in, unsigned long in_len,
+			     char **out);
+
+extern int
+cryptfs_tpm2_util_hex_decode(const char *in, unsigned long in_len,
+			     uint8_t **out, unsigned long *out_len);
+
+extern int
+cryptfs_tpm2_util_write_fd(int fd, const uint8_t *buf, unsigned long size);
+
+extern int
+cryptfs_tpm2_util_exec_with_input(const char *cmd, const uint8_t *buf,
+				  unsigned long size);
+
 extern int
 cryptfs_tpm2_util_get_owner_auth(uint8_t *owner_auth,
 				 unsigned int *owner_auth_size);
@@ -299,6 +461,9 @@ cryptfs_tpm2_tcti_init_context(void);
 extern void
 cryptfs_tpm2_tcti_teardown_context(TSS2_TCTI_CONTEXT *ctx);
 
+extern void
+cryptfs_tpm2_tcti_unload(void);
+
 extern int
 cryptfs_tpm2_option_set_owner_auth(uint8_t *buf, unsigned int *buf_size);
 
@@ -333,20 +498,43 @@ cryptfs_tpm2_option_set_interactive(void);
 extern int
 cryptfs_tpm2_option_get_interactive(bool *required);
 
+extern void
+cryptfs_tpm2_option_set_tpm_hash(void);
+
+extern int
+cryptfs_tpm2_option_get_tpm_hash(bool *required);
+
 extern int
 cryptefs_tpm2_get_random(uint8_t *random, size_t *req_size);
 
 extern int
-cryptfs_tpm2_create_primary_key(TPMI_ALG_HASH pcr_bank_alg);
+cryptfs_tpm2_create_primary_key(TPMI_ALG_HASH pcr_bank_alg,
+				TPMI_ALG_PUBLIC key_type);
+
+extern int
+cryptfs_tpm2_select_parent(cryptfs_tpm2_parent_t mode,
+			   TPMI_DH_OBJECT *parent);
 
 extern int
 cryptfs_tpm2_create_passphrase(char *passphrase, size_t passphrase_size,
-                               TPMI_ALG_HASH pcr_bank_alg);
+                               TPMI_ALG_HASH pcr_bank_alg,
+			       TPMI_DH_OBJECT parent);
+
+extern int
+cryptfs_tpm2_create_passphrase_blob(char *passphrase, size_t passphrase_size,
+				    TPMI_ALG_HASH pcr_bank_alg,
+				    TPMI_DH_OBJECT parent, void **blob,
+				    size_t *blob_size);
 
 extern int
 cryptfs_tpm2_unseal_passphrase(TPMI_ALG_HASH pcr_bank_alg, void **passphrase,
 			       size_t *passphrase_size);
 
+extern int
+cryptfs_tpm2_unseal_passphrase_blob(TPMI_ALG_HASH pcr_bank_alg,
+				    const void *blob, size_t blob_size,
+				    void **passphrase, size_t *passphrase_size);
+
 extern int
 cryptfs_tpm2_evict_primary_key(void);
 
@@ -365,6 +553,15 @@ cryptfs_tpm2_capability_digest_supported(TPMI_ALG_HASH *hash_alg);
 bool
 cryptfs_tpm2_capability_pcr_bank_supported(TPMI_ALG_HASH *hash_alg);
 
+extern bool
+cryptfs_tpm2_capability_ecc_p256_supported(void);
+
+extern bool
+cryptfs_tpm2_capability_srk_compatible(void);
+
+extern bool
+cryptfs_tpm2_capability_command_supported(UINT32 command_code);
+
 int
 cryptfs_tpm2_capability_in_lockout(bool *in_lockout);
 
@@ -389,8 +586,46 @@ cryptfs_tpm2_capability_get_max_tries(UINT32 *max_tries);
 extern int
 cryptfs_tpm2_capability_get_lockout_recovery(UINT32 *recovery);
 
+extern void
+cryptfs_tpm2_capability_invalidate(void);
+
+extern int
+cryptfs_tpm2_capability_ping(void);
+
+extern int
+cryptfs_tpm2_capability_get_voted_pcr_bank(TPMI_ALG_HASH *bank_alg,
+					   UINT32 *pcr_update_counter);
+
 int
 cryptfs_tpm2_read_pcr(TPMI_ALG_HASH bank_alg, unsigned int index,
 		      BYTE *out);
 
+int
+cryptfs_tpm2_init(void);
+
+void
+cryptfs_tpm2_teardown(void);
+
+int
+cryptfs_tpm2_agent_send(int fd, uint8_t command, int32_t status,
+			const void *payload, uint32_t payload_size);
+
+int
+cryptfs_tpm2_agent_recv(int fd, cryptfs_tpm2_agent_header_t *hdr,
+			uint8_t **payload);
+
+int
+cryptfs_tpm2_agent_connect(const char *socket_path);
+
+int
+cryptfs_tpm2_agent_call(const char *socket_path, uint8_t command,
+			const void *req, uint32_t req_size,
+			uint8_t **rsp, uint32_t *rsp_size);
+
+int
+cryptfs_tpm2_trace_start(const char *file);
+
+int
+cryptfs_tpm2_trace_stop(void);
+
 #endif	/* CRYPTFS_TPM2_H */
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2024, Alibaba Cloud
+ * Copyright (c) 2016-2023, Wind River Systems, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1) Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2) Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3) Neither the name of Wind River Systems nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author:
+ *        Jia Zhang <zhang.jia@linux.alibaba.com>
+ */
+
+#include <cryptfs_tpm2.h>
+
+#include "internal.h"
+
+static int
+read_full(int fd, void *buf, size_t size)
+{
+	while (size) {
+		ssize_t len = read(fd, buf, size);
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -1;
+		}
+
+		/* The peer closed the connection */
+		if (!len) {
+			errno = ECONNRESET;
+			return -1;
+		}
+
+		buf = (uint8_t *)buf + len;
+		size -= len;
+	}
+
+	return 0;
+}
+
+static int
+write_full(int fd, const void *buf, size_t size)
+{
+	while (size) {
+		ssize_t len = send(fd, buf, size, MSG_NOSIGNAL);
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -1;
+		}
+
+		buf = (const uint8_t *)buf + len;
+		size -= len;
+	}
+
+	return 0;
+}
+
+int
+cryptfs_tpm2_agent_send(int fd, uint8_t command, int32_t status,
+			const void *payload, uint32_t payload_size)
+{
+	cryptfs_tpm2_agent_header_t hdr = {
+		.magic = CRYPTFS_TPM2_AGENT_MAGIC,
+		.version = CRYPTFS_TPM2_AGENT_VERSION,
+		.command = command,
+		.status = status,
+		.payload_size = payload_size,
+	};
+
+	if (write_full(fd, &hdr, sizeof(hdr)))
+		return -1;
+
+	if (payload_size && write_full(fd, payload, payload_size))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * The caller is responsible for freeing the returned payload.
+ */
+int
+cryptfs_tpm2_agent_recv(int fd, cryptfs_tpm2_agent_header_t *hdr,
+			uint8_t **payload)
+{
+	*payload = NULL;
+
+	if (read_full(fd, hdr, sizeof(*hdr)))
+		return -1;
+
+	if (hdr->magic != CRYPTFS_TPM2_AGENT_MAGIC ||
+	    hdr->version != CRYPTFS_TPM2_AGENT_VERSION) {
+		err("Invalid agent message header\n");
+		return -1;
+	}
+
+	if (hdr->payload_size > CRYPTFS_TPM2_AGENT_MAX_PAYLOAD) {
+		err("The agent message payload is too large (%d-byte)\n",
+		    hdr->payload_size);
+		return -1;
+	}
+
+	if (!hdr->payload_size)
+		return 0;
+
+	*payload = malloc(hdr->payload_size);
+	if (!*payload)
+		return -1;
+
+	if (read_full(fd, *payload, hdr->payload_size)) {
+		free(*payload);
+		*payload = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+cryptfs_tpm2_agent_connect(const char *socket_path)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		err("The agent socket path is too long\n");
+		return -1;
+	}
+
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		err("Unable to create the agent socket (%s)\n",
+		    strerror(errno));
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		err("Unable to connect the agent %s (%s)\n", socket_path,
+		    strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * Issue one request to the agent and wait for the response.
+ *
+ * Return the status of the response, or -1 if unable to talk to the
+ * agent. The caller is responsible for freeing the response payload.
+ */
+int
+cryptfs_tpm2_agent_call(const char *socket_path, uint8_t command,
+			const void *req, uint32_t req_size,
+			uint8_t **rsp, uint32_t *rsp_size)
+{
+	int fd = cryptfs_tpm2_agent_connect(socket_path);
+	if (fd < 0)
+		return -1;
+
+	int rc = -1;
+	cryptfs_tpm2_agent_header_t hdr;
+	uint8_t *payload;
+
+	if (cryptfs_tpm2_agent_send(fd, command, 0, req, req_size)) {
+		err("Unable to send the request to the agent (%s)\n",
+		    strerror(errno));
+		goto out;
+	}
+
+	if (cryptfs_tpm2_agent_recv(fd, &hdr, &payload)) {
+		err("Unable to receive the response from the agent (%s)\n",
+		    strerror(errno));
+		goto out;
+	}
+
+	if (hdr.command != command) {
+		err("Mismatched agent response (%d)\n", hdr.command);
+		free(payload);
+		goto out;
+	}
+
+	if (rsp) {
+		*rsp = payload;
+		*rsp_size = hdr.payload_size;
+	} else
+		free(payload);
+
+	rc = hdr.status;
+
+out:
+	close(fd);
+
+	return rc;
+}
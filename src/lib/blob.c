@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2024, Alibaba Cloud
+ * Copyright (c) 2016-2023, Wind River Systems, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1) Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2) Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3) Neither the name of Wind River Systems nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author:
+ *        Jia Zhang <zhang.jia@linux.alibaba.com>
+ */
+
+#include <cryptfs_tpm2.h>
+
+#include "internal.h"
+
+#ifndef TSS2_LEGACY_V1
+/*
+ * The sealed passphrase object is exported as a blob in TPM wire format,
+ * so it can be stored out of TPM, e.g, in the LUKS2 token, and loaded
+ * again at unseal time:
+ *
+ *   UINT32		magic
+ *   TPMI_DH_OBJECT	parent
+ *   TPM2B_PRIVATE	private
+ *   TPM2B_PUBLIC	public
+ */
+#define BLOB_MAGIC		0x63667462	/* "cftb" */
+
+static unsigned int
+marshal_uint16(BYTE *buf, UINT16 val)
+{
+	buf[0] = val >> 8;
+	buf[1] = val;
+
+	return sizeof(val);
+}
+
+static unsigned int
+marshal_uint32(BYTE *buf, UINT32 val)
+{
+	buf[0] = val >> 24;
+	buf[1] = val >> 16;
+	buf[2] = val >> 8;
+	buf[3] = val;
+
+	return sizeof(val);
+}
+
+static unsigned int
+unmarshal_uint16(const BYTE *buf, UINT16 *val)
+{
+	*val = (buf[0] << 8) | buf[1];
+
+	return sizeof(*val);
+}
+
+static unsigned int
+unmarshal_uint32(const BYTE *buf, UINT32 *val)
+{
+	*val = ((UINT32)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) |
+	       buf[3];
+
+	return sizeof(*val);
+}
+
+/*
+ * Only the sealed data object, i.e, a keyedhash object without scheme,
+ * is handled. The buffer must be as large as TPMT_PUBLIC.
+ */
+int
+sealed_public_marshal(TPMT_PUBLIC *public, BYTE *buf, UINT16 *size)
+{
+	if (public->type != TPM2_ALG_KEYEDHASH ||
+	    public->parameters.keyedHashDetail.scheme.scheme !=
+	    TPM2_ALG_NULL)
+		return -1;
+
+	unsigned int len = 0;
+
+	len += marshal_uint16(buf + len, public->type);
+	len += marshal_uint16(buf + len, public->nameAlg);
+	len += marshal_uint32(buf + len, public->objectAttributes);
+	len += marshal_uint16(buf + len, public->authPolicy.size);
+	memcpy(buf + len, public->authPolicy.buffer,
+	       public->authPolicy.size);
+	len += public->authPolicy.size;
+	len += marshal_uint16(buf + len, TPM2_ALG_NULL);
+	len += marshal_uint16(buf + len, public->unique.keyedHash.size);
+	memcpy(buf + len, public->unique.keyedHash.buffer,
+	       public->unique.keyedHash.size);
+	len += public->unique.keyedHash.size;
+
+	*size = len;
+
+	return 0;
+}
+
+static int
+unmarshal_digest(const BYTE *buf, UINT16 size, unsigned int *off,
+		 TPM2B_DIGEST *digest)
+{
+	if (*off + sizeof(UINT16) > size)
+		return -1;
+
+	*off += unmarshal_uint16(buf + *off, &digest->size);
+	if (digest->size > sizeof(digest->buffer) ||
+	    *off + digest->size > size)
+		return -1;
+
+	memcpy(digest->buffer, buf + *off, digest->size);
+	*off += digest->size;
+
+	return 0;
+}
+
+static int
+sealed_public_unmarshal(const BYTE *buf, UINT16 size, TPMT_PUBLIC *public)
+{
+	unsigned int off = 0;
+	UINT16 scheme;
+
+	memset(public, 0, sizeof(*public));
+
+	if (size < sizeof(UINT16) * 2 + sizeof(UINT32))
+		return -1;
+
+	off += unmarshal_uint16(buf + off, &public->type);
+	off += unmarshal_uint16(buf + off, &public->nameAlg);
+	off += unmarshal_uint32(buf + off, &public->objectAttributes);
+	if (public->type != TPM2_ALG_KEYEDHASH)
+		return -1;
+
+	if (unmarshal_digest(buf, size, &off, &public->authPolicy))
+		return -1;
+
+	if (off + sizeof(scheme) > size)
+		return -1;
+
+	off += unmarshal_uint16(buf + off, &scheme);
+	if (scheme != TPM2_ALG_NULL)
+		return -1;
+
+	public->parameters.keyedHashDetail.scheme.scheme = scheme;
+
+	if (unmarshal_digest(buf, size, &off, &public->unique.keyedHash))
+		return -1;
+
+	return off == size ? 0 : -1;
+}
+
+int
+blob_marshal(TPMI_DH_OBJECT parent, TPM2B_PRIVATE *private,
+	     TPM2B_PUBLIC *public, void **blob, size_t *blob_size)
+{
+	BYTE *buf = malloc(sizeof(UINT32) + sizeof(TPMI_DH_OBJECT) +
+			   sizeof(*private) + sizeof(*public));
+	if (!buf) {
+		err("Unable to allocate the blob\n");
+		return -1;
+	}
+
+	unsigned int len = 0;
+
+	len += marshal_uint32(buf + len, BLOB_MAGIC);
+	len += marshal_uint32(buf + len, parent);
+	len += marshal_uint16(buf + len, private->size);
+	memcpy(buf + len, private->buffer, private->size);
+	len += private->size;
+
+	UINT16 public_size;
+
+	if (sealed_public_marshal(&public->publicArea,
+				  buf + len + sizeof(UINT16),
+				  &public_size)) {
+		err("Unsupported type of the object to be exported\n");
+		free(buf);
+		return -1;
+	}
+
+	len += marshal_uint16(buf + len, public_size);
+	len += public_size;
+
+	*blob = buf;
+	*blob_size = len;
+
+	return 0;
+}
+
+int
+blob_unmarshal(const void *blob, size_t blob_size, TPMI_DH_OBJECT *parent,
+	       TPM2B_PRIVATE *private, TPM2B_PUBLIC *public)
+{
+	const BYTE *buf = blob;
+	unsigned int off = 0;
+	UINT32 magic;
+
+	if (blob_size < sizeof(magic) + sizeof(*parent) + sizeof(UINT16))
+		goto err;
+
+	off += unmarshal_uint32(buf + off, &magic);
+	if (magic != BLOB_MAGIC)
+		goto err;
+
+	off += unmarshal_uint32(buf + off, parent);
+	off += unmarshal_uint16(buf + off, &private->size);
+	if (private->size > sizeof(private->buffer) ||
+	    off + private->size + sizeof(UINT16) > blob_size)
+		goto err;
+
+	memcpy(private->buffer, buf + off, private->size);
+	off += private->size;
+
+	off += unmarshal_uint16(buf + off, &public->size);
+	if (off + public->size != blob_size)
+		goto err;
+
+	if (sealed_public_unmarshal(buf + off, public->size,
+				    &public->publicArea))
+		goto err;
+
+	return 0;
+
+err:
+	err("Invalid blob of the sealed object\n");
+	return -1;
+}
+#endif
@@ -43,54 +43,108 @@ typedef struct {
 	unsigned int weight;
 } digest_alg_weight_t;
 
-int
-capability_read_public(TPMI_DH_OBJECT handle, TPM2B_PUBLIC *public_out)
+/*
+ * Cache of handle -> public area for the present objects. Seal and evict
+ * keep it up to date, and cryptfs_tpm2_capability_invalidate() drops it
+ * in case the objects are changed by others. An absent handle is never
+ * cached because it may be created by others at any time.
+ */
+#define PUBLIC_CACHE_SIZE	8
+
+static struct {
+	TPMI_DH_OBJECT handle;
+	TPM2B_PUBLIC public;
+} public_cache[PUBLIC_CACHE_SIZE];
+static unsigned int nr_public_cache;
+static unsigned int public_cache_victim;
+
+static int
+lookup_public_cache(TPMI_DH_OBJECT handle)
 {
-	TPMI_YES_NO more_data;
-	TPMS_CAPABILITY_DATA capability_data;
+	for (unsigned int i = 0; i < nr_public_cache; ++i) {
+		if (public_cache[i].handle == handle)
+			return i;
+	}
 
-	UINT32 rc = Tss2_Sys_GetCapability(cryptfs_tpm2_sys_context, NULL,
-					   TPM2_CAP_HANDLES, TPM2_HT_PERSISTENT,
-					   TPM2_HR_PERSISTENT, &more_data,
-					   &capability_data, NULL);
-	if (rc != TPM2_RC_SUCCESS) {
-		err("Unable to get the TPM persistent handles (%#x)", rc);
-		return -1;
-	};
+	return -1;
+}
 
-	dbg("%d persistent objects detected:\n", capability_data.data.handles.count);
-	for (UINT32 i = 0; i < capability_data.data.handles.count; ++i) {
-		TPMI_DH_OBJECT h = capability_data.data.handles.handle[i];
+void
+capability_cache_public(TPMI_DH_OBJECT handle, TPM2B_PUBLIC *public)
+{
+	int i = lookup_public_cache(handle);
+
+	if (i < 0) {
+		if (nr_public_cache < PUBLIC_CACHE_SIZE)
+			i = nr_public_cache++;
+		else {
+			i = public_cache_victim++;
+			public_cache_victim %= PUBLIC_CACHE_SIZE;
+		}
 
-        	dbg_cont("  [%02d] %#8.8x\n", i, h);
+		public_cache[i].handle = handle;
+	}
 
-		if (h != handle)
-			continue;
+	public_cache[i].public = *public;
+}
+
+void
+capability_uncache_public(TPMI_DH_OBJECT handle)
+{
+	int i = lookup_public_cache(handle);
+
+	if (i < 0)
+		return;
+
+	public_cache[i] = public_cache[--nr_public_cache];
+	if (public_cache_victim >= nr_public_cache)
+		public_cache_victim = 0;
+}
+
+/*
+ * Read the public area of the object with the specified handle.
+ *
+ * Return 0 if the object is present, 1 if not present, or -1 on error.
+ */
+int
+capability_read_public(TPMI_DH_OBJECT handle, TPM2B_PUBLIC *public_out)
+{
+	int i = lookup_public_cache(handle);
 
-        	/* Actually TPM2_ReadPublic doesn't require any authorization */
-        	struct session_complex s;
-		password_session_create(&s, NULL, 0);
+	if (i >= 0) {
+		*public_out = public_cache[i].public;
+
+		return 0;
+	}
 
 #ifndef TSS2_LEGACY_V1
-		TPM2B_NAME name = { sizeof(TPM2B_NAME)-2, };
-		TPM2B_NAME qualified_name = { sizeof(TPM2B_NAME)-2, };
+	TPM2B_NAME name = { sizeof(TPM2B_NAME)-2, };
+	TPM2B_NAME qualified_name = { sizeof(TPM2B_NAME)-2, };
 #else
-		TPM2B_NAME name = { { sizeof(TPM2B_NAME)-2, } };
-		TPM2B_NAME qualified_name = { { sizeof(TPM2B_NAME)-2, } };
+	TPM2B_NAME name = { { sizeof(TPM2B_NAME)-2, } };
+	TPM2B_NAME qualified_name = { { sizeof(TPM2B_NAME)-2, } };
 #endif
-		rc = Tss2_Sys_ReadPublic(cryptfs_tpm2_sys_context, handle,
-					 NULL, public_out, &name,
-					 &qualified_name, &s.sessionsDataOut);
-		if (rc != TPM2_RC_SUCCESS) {
-			err("Unable to read the public area for the "
-			    "persistent handle %#8.8x (%#x)", handle, rc);
-			return -1;
+
+	/* TPM2_ReadPublic doesn't require any authorization */
+	UINT32 rc = Tss2_Sys_ReadPublic(tss2_sys_context(), handle,
+					NULL, public_out, &name,
+					&qualified_name, NULL);
+	if (rc != TPM2_RC_SUCCESS) {
+		if (tpm2_rc_is_format_one(rc) &&
+		    (tpm2_rc_get_code_7bit(rc) | TPM2_RC_FMT1) ==
+		    TPM2_RC_HANDLE) {
+			dbg("The object %#8.8x is not present\n", handle);
+			return 1;
 		}
 
-		return 0;
+		err("Unable to read the public area for the "
+		    "handle %#8.8x (%#x)\n", handle, rc);
+		return -1;
 	}
 
-	return -1;
+	capability_cache_public(handle, public_out);
+
+	return 0;
 }
 
 static unsigned int
@@ -246,7 +300,7 @@ cryptfs_tpm2_capability_digest_algorithm_supported(TPMI_ALG_HASH *hash_alg)
 	TPMS_CAPABILITY_DATA capability_data;
 	UINT32 rc;
 
-	rc = Tss2_Sys_GetCapability(cryptfs_tpm2_sys_context, NULL,
+	rc = Tss2_Sys_GetCapability(tss2_sys_context(), NULL,
 				    TPM2_CAP_ALGS, TPM2_PT_NONE, 1, &more_data,
 				    &capability_data, NULL);
 	if (rc != TPM2_RC_SUCCESS) {
@@ -302,6 +356,229 @@ cryptfs_tpm2_capability_digest_algorithm_supported(TPMI_ALG_HASH *hash_alg)
 	return true;
 }
 
+/*
+ * Check whether TPM is able to create a NIST P-256 key, which is the
+ * mandatory curve in PC Client profile but still optional on some
+ * discrete TPMs.
+ */
+bool
+cryptfs_tpm2_capability_ecc_p256_supported(void)
+{
+	TPMI_YES_NO more_data;
+	TPMS_CAPABILITY_DATA capability_data;
+	UINT32 rc;
+
+	rc = Tss2_Sys_GetCapability(tss2_sys_context(), NULL,
+				    TPM2_CAP_ECC_CURVES, TPM2_ECC_NONE,
+				    TPM2_MAX_ECC_CURVES, &more_data,
+				    &capability_data, NULL);
+	if (rc != TPM2_RC_SUCCESS) {
+		dbg("Unable to get the TPM supported ECC curves (%#x)\n",
+		    rc);
+		return false;
+	}
+
+	TPML_ECC_CURVE *curves = &capability_data.data.eccCurves;
+
+	for (unsigned int i = 0; i < curves->count; ++i) {
+		if (curves->eccCurves[i] == TPM2_ECC_NIST_P256)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Check whether the persistent SRK follows the TCG storage key template,
+ * i.e, a restricted decryption key with AES-128-CFB, authorized with
+ * the empty password. This costs one TPM2_ReadPublic at most.
+ */
+bool
+cryptfs_tpm2_capability_srk_compatible(void)
+{
+	TPM2B_PUBLIC public;
+
+	if (capability_read_public(CRYPTFS_TPM2_SRK_HANDLE, &public))
+		return false;
+
+#ifndef TSS2_LEGACY_V1
+	TPMT_PUBLIC *area = &public.publicArea;
+	TPMA_OBJECT required = TPMA_OBJECT_FIXEDTPM |
+			       TPMA_OBJECT_FIXEDPARENT |
+			       TPMA_OBJECT_SENSITIVEDATAORIGIN |
+			       TPMA_OBJECT_USERWITHAUTH |
+			       TPMA_OBJECT_RESTRICTED |
+			       TPMA_OBJECT_DECRYPT;
+
+	if ((area->objectAttributes & (required |
+				       TPMA_OBJECT_SIGN_ENCRYPT)) !=
+	    required) {
+#else
+	TPMT_PUBLIC *area = &public.t.publicArea;
+
+	if (!area->objectAttributes.fixedTPM ||
+	    !area->objectAttributes.fixedParent ||
+	    !area->objectAttributes.sensitiveDataOrigin ||
+	    !area->objectAttributes.userWithAuth ||
+	    !area->objectAttributes.restricted ||
+	    !area->objectAttributes.decrypt ||
+	    area->objectAttributes.sign) {
+#endif
+		dbg("The SRK is not a storage key\n");
+		return false;
+	}
+
+	TPMT_SYM_DEF_OBJECT *symmetric;
+
+	switch (area->type) {
+	case TPM2_ALG_RSA:
+		symmetric = &area->parameters.rsaDetail.symmetric;
+		break;
+	case TPM2_ALG_ECC:
+		symmetric = &area->parameters.eccDetail.symmetric;
+		break;
+	default:
+		dbg("The SRK type %#x is not supported\n", area->type);
+		return false;
+	}
+
+	if (symmetric->algorithm != TPM2_ALG_AES ||
+	    symmetric->keyBits.aes != 128 ||
+	    symmetric->mode.aes != TPM2_ALG_CFB) {
+		dbg("The SRK symmetric algorithm is not AES-128-CFB\n");
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Check whether TPM implements the specified command, which may be
+ * optional in PC Client profile, e.g, TPM2_CreateLoaded.
+ */
+bool
+cryptfs_tpm2_capability_command_supported(UINT32 command_code)
+{
+	TPMI_YES_NO more_data;
+	TPMS_CAPABILITY_DATA capability_data;
+	UINT32 rc;
+
+	rc = Tss2_Sys_GetCapability(tss2_sys_context(), NULL,
+				    TPM2_CAP_COMMANDS, command_code, 1,
+				    &more_data, &capability_data, NULL);
+	if (rc != TPM2_RC_SUCCESS) {
+		dbg("Unable to get the TPM supported commands (%#x)\n", rc);
+		return false;
+	}
+
+	TPML_CCA *commands = &capability_data.data.command;
+
+	if (!commands->count)
+		return false;
+
+#ifndef TSS2_LEGACY_V1
+	return (commands->commandAttributes[0] &
+		TPMA_CC_COMMANDINDEX_MASK) == (command_code & 0xffff);
+#else
+	return commands->commandAttributes[0].commandIndex ==
+	       (command_code & 0xffff);
+#endif
+}
+
+/*
+ * The PCR read for voting the PCR bank, reused once by the following
+ * policy step. PCR may be extended at any time after that, so the value
+ * is never reused twice.
+ */
+static TPMI_ALG_HASH voted_pcr_bank = TPM2_ALG_NULL;
+static TPM2B_DIGEST voted_pcr_value;
+static bool voted_pcr_value_valid;
+static UINT32 voted_pcr_update_counter;
+
+/*
+ * Read the PCR with the specified index from all the banks with a single
+ * TPM2_PCR_Read. TPM may return less banks than requested if the response
+ * doesn't fit, so the remaining banks are read again.
+ */
+static int
+read_pcr_banks(TPML_PCR_SELECTION *banks, unsigned int index,
+	       TPM2B_DIGEST *values, UINT32 *pcr_update_counter)
+{
+	TPML_PCR_SELECTION pcrs;
+
+	pcrs.count = 0;
+	for (UINT32 i = 0; i < banks->count; ++i) {
+		TPMS_PCR_SELECTION *bank = banks->pcrSelections + i;
+
+#ifndef TSS2_LEGACY_V1
+		values[i].size = 0;
+#else
+		values[i].t.size = 0;
+#endif
+
+		if (index / 8 >= bank->sizeofSelect ||
+		    !(bank->pcrSelect[index / 8] & (1 << (index % 8))))
+			continue;
+
+		TPMS_PCR_SELECTION *pcr_sel = pcrs.pcrSelections + pcrs.count++;
+
+		pcr_sel->hash = bank->hash;
+		pcr_sel->sizeofSelect = 3;
+		memset(pcr_sel->pcrSelect, 0, TPM2_PCR_SELECT_MAX);
+		pcr_sel->pcrSelect[index / 8] |= (1 << (index % 8));
+	}
+
+	while (pcrs.count) {
+		TPML_PCR_SELECTION pcrs_out;
+		TPML_DIGEST pcr_values;
+		UINT32 rc;
+
+		rc = Tss2_Sys_PCR_Read(tss2_sys_context(), NULL, &pcrs,
+				       pcr_update_counter, &pcrs_out,
+				       &pcr_values, NULL);
+		if (rc != TPM2_RC_SUCCESS) {
+			err("Unable to read the PCRs (%#x)\n", rc);
+			return -1;
+		}
+
+		UINT32 nr_value = 0;
+
+		for (UINT32 c = 0; c < pcrs_out.count &&
+				   nr_value < pcr_values.count; ++c) {
+			TPMS_PCR_SELECTION *pcr_sel = pcrs_out.pcrSelections + c;
+
+			if (index / 8 >= pcr_sel->sizeofSelect ||
+			    !(pcr_sel->pcrSelect[index / 8] &
+			      (1 << (index % 8))))
+				continue;
+
+			for (UINT32 i = 0; i < banks->count; ++i) {
+				if (banks->pcrSelections[i].hash ==
+				    pcr_sel->hash)
+					values[i] = pcr_values.digests[nr_value];
+			}
+
+			/* Drop the bank already read */
+			for (UINT32 i = 0; i < pcrs.count; ++i) {
+				if (pcrs.pcrSelections[i].hash !=
+				    pcr_sel->hash)
+					continue;
+
+				pcrs.pcrSelections[i] =
+					pcrs.pcrSelections[--pcrs.count];
+				break;
+			}
+
+			++nr_value;
+		}
+
+		if (!nr_value)
+			break;
+	}
+
+	return 0;
+}
+
 bool
 cryptfs_tpm2_capability_pcr_bank_supported(TPMI_ALG_HASH *hash_alg)
 {
@@ -309,7 +586,7 @@ cryptfs_tpm2_capability_pcr_bank_supported(TPMI_ALG_HASH *hash_alg)
 	TPMS_CAPABILITY_DATA capability_data;
 	UINT32 rc;
 
-	rc = Tss2_Sys_GetCapability(cryptfs_tpm2_sys_context, NULL,
+	rc = Tss2_Sys_GetCapability(tss2_sys_context(), NULL,
 				    TPM2_CAP_PCRS, TPM2_PT_NONE, 1, &more_data,
 				    &capability_data, NULL);
 	if (rc != TPM2_RC_SUCCESS) {
@@ -330,34 +607,49 @@ cryptfs_tpm2_capability_pcr_bank_supported(TPMI_ALG_HASH *hash_alg)
 	dbg_cont("\n");
 #endif
 
+	for (i = 0; i < banks->count; ++i) {
+		if (*hash_alg == banks->pcrSelections[i].hash)
+			return true;
+	}
+
+	if (*hash_alg != TPM2_ALG_AUTO)
+		return false;
+
+	TPM2B_DIGEST pcr_values[banks->count];
+	UINT32 pcr_update_counter;
+
+	if (read_pcr_banks(banks, CRYPTFS_TPM2_PCR_INDEX, pcr_values,
+			   &pcr_update_counter))
+		return false;
+
 	TPMI_ALG_HASH preferred_alg = TPM2_ALG_NULL;
+	unsigned int preferred = 0;
 	unsigned int weight = 0;
 
 	for (i = 0; i < banks->count; ++i) {
 		TPMI_ALG_HASH bank_alg;
 
 		bank_alg = banks->pcrSelections[i].hash;
-		if (*hash_alg == bank_alg)
-			return true;
 
-		if (*hash_alg != TPM2_ALG_AUTO)
-			continue;
+		UINT16 alg_size;
 
-		unsigned int alg_weight;
+		if (util_digest_size(bank_alg, &alg_size))
+			continue;
 
-		alg_weight = weight_digest_algorithm(bank_alg);
+#ifndef TSS2_LEGACY_V1
+		BYTE *pcr_value = pcr_values[i].buffer;
 
-		UINT16 alg_size;
+		if (pcr_values[i].size != alg_size)
+#else
+		BYTE *pcr_value = pcr_values[i].t.buffer;
 
-		util_digest_size(bank_alg, &alg_size);
+		if (pcr_values[i].t.size != alg_size)
+#endif
+			continue;
 
-		BYTE pcr_value[alg_size];
+		unsigned int alg_weight;
 
-		rc = cryptfs_tpm2_read_pcr(bank_alg,
-					   CRYPTFS_TPM2_PCR_INDEX,
-					   pcr_value);
-		if (rc != TPM2_RC_SUCCESS)
-			continue;
+		alg_weight = weight_digest_algorithm(bank_alg);
 
 		if (is_null_hash(pcr_value, alg_size)) {
 			warn("%s PCR bank is unused\n",
@@ -369,57 +661,174 @@ cryptfs_tpm2_capability_pcr_bank_supported(TPMI_ALG_HASH *hash_alg)
 		if (alg_weight > weight) {
 			weight = alg_weight;
 			preferred_alg = bank_alg;
+			preferred = i;
 		}
 	}
 
-	if (*hash_alg != TPM2_ALG_AUTO)
-		return false;
-
 	if (preferred_alg == TPM2_ALG_NULL)
 		return false;
 
 	*hash_alg = preferred_alg;
 
+	voted_pcr_bank = preferred_alg;
+	voted_pcr_value = pcr_values[preferred];
+	voted_pcr_value_valid = true;
+	voted_pcr_update_counter = pcr_update_counter;
+
 	info("%s PCR bank voted\n", show_algorithm_name(preferred_alg));
 
 	return true;
 }
 
+int
+cryptfs_tpm2_capability_get_voted_pcr_bank(TPMI_ALG_HASH *bank_alg,
+					   UINT32 *pcr_update_counter)
+{
+	if (!bank_alg || voted_pcr_bank == TPM2_ALG_NULL)
+		return EXIT_FAILURE;
+
+	*bank_alg = voted_pcr_bank;
+	if (pcr_update_counter)
+		*pcr_update_counter = voted_pcr_update_counter;
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Serve the PCR read requested by the policy step with the one done for
+ * voting the PCR bank, if it only covers the voted PCR. The value is
+ * consumed, so any later policy step reads the current PCR from TPM.
+ */
+int
+capability_read_voted_pcr(TPML_PCR_SELECTION *pcrs,
+			  TPML_PCR_SELECTION *pcrs_out,
+			  TPML_DIGEST *pcr_values)
+{
+	unsigned int index = CRYPTFS_TPM2_PCR_INDEX;
+
+	if (voted_pcr_value_valid == false || pcrs->count != 1 ||
+	    pcrs->pcrSelections->hash != voted_pcr_bank)
+		return -1;
+
+	TPMS_PCR_SELECTION *pcr_sel = pcrs->pcrSelections;
+
+	for (UINT8 s = 0; s < pcr_sel->sizeofSelect; ++s) {
+		BYTE sel = 0;
+
+		if (s == index / 8)
+			sel = 1 << (index % 8);
+
+		if (pcr_sel->pcrSelect[s] != sel)
+			return -1;
+	}
+
+	dbg("Reuse PCR %d read for voting (pcrUpdateCounter %d)\n", index,
+	    voted_pcr_update_counter);
+
+	*pcrs_out = *pcrs;
+	pcr_values->count = 1;
+	pcr_values->digests[0] = voted_pcr_value;
+
+	voted_pcr_value_valid = false;
+
+	return 0;
+}
+
+/*
+ * Snapshot of the variable TPM properties, starting from TPM_PT_PERMANENT.
+ * All the getters below are served from it, so the whole group costs one
+ * paginated query. The caller must invalidate it after any command which
+ * may change the DA state.
+ */
+#define PROPERTY_GROUP_SIZE	0x100
+
+static TPMS_TAGGED_PROPERTY property_snapshot[PROPERTY_GROUP_SIZE];
+static unsigned int nr_property_snapshot;
+static bool property_snapshot_valid;
+
 static UINT32
-get_permanent_property(TPM2_PT property, UINT32 *value)
+take_property_snapshot(void)
 {
+	TPM2_PT property = TPM2_PT_PERMANENT;
 	TPMI_YES_NO more_data;
 	TPMS_CAPABILITY_DATA capability_data;
 	UINT32 rc;
 
-	rc = Tss2_Sys_GetCapability(cryptfs_tpm2_sys_context, NULL,
-				    TPM2_CAP_TPM_PROPERTIES, property,
-				    1, &more_data,
-				    &capability_data, NULL);
-	if (rc != TPM2_RC_SUCCESS) {
-		err("Unable to get the TPM properties (%#x)", rc);
-		return rc;
-	}
+	nr_property_snapshot = 0;
 
-	TPML_TAGGED_TPM_PROPERTY *properties;
+	do {
+		rc = Tss2_Sys_GetCapability(tss2_sys_context(), NULL,
+					    TPM2_CAP_TPM_PROPERTIES, property,
+					    TPM2_MAX_TPM_PROPERTIES,
+					    &more_data, &capability_data,
+					    NULL);
+		if (rc != TPM2_RC_SUCCESS) {
+			err("Unable to get the TPM properties (%#x)", rc);
+			return rc;
+		}
+
+		TPML_TAGGED_TPM_PROPERTY *properties;
 
-	properties = &capability_data.data.tpmProperties;
+		properties = &capability_data.data.tpmProperties;
+		if (!properties->count)
+			break;
 
-	if (properties->count != 1)
-		die("Invalid number of TPM permanent properties (%d)\n",
-		    properties->count);
+		for (UINT32 i = 0; i < properties->count; ++i) {
+			TPMS_TAGGED_PROPERTY *tagged_property;
 
-	TPMS_TAGGED_PROPERTY *tagged_property = properties->tpmProperty;
+			tagged_property = properties->tpmProperty + i;
+			if (tagged_property->property >=
+			    TPM2_PT_PERMANENT + PROPERTY_GROUP_SIZE) {
+				more_data = 0;
+				break;
+			}
+
+			property_snapshot[nr_property_snapshot++] =
+				*tagged_property;
+		}
 
-	if (tagged_property->property != property)
-		die("Invalid tagged property (0x%x)\n",
-		    tagged_property->property);
+		property = properties->tpmProperty[properties->count - 1].property + 1;
+	} while (more_data &&
+		 nr_property_snapshot < PROPERTY_GROUP_SIZE);
 
-	*value = tagged_property->value;
+	dbg("%d TPM properties snapshotted\n", nr_property_snapshot);
+
+	property_snapshot_valid = true;
 
 	return TPM2_RC_SUCCESS;
 }
 
+void
+cryptfs_tpm2_capability_invalidate(void)
+{
+	nr_public_cache = 0;
+	public_cache_victim = 0;
+	property_snapshot_valid = false;
+	voted_pcr_value_valid = false;
+}
+
+static UINT32
+get_permanent_property(TPM2_PT property, UINT32 *value)
+{
+	if (property_snapshot_valid == false) {
+		UINT32 rc = take_property_snapshot();
+
+		if (rc != TPM2_RC_SUCCESS)
+			return rc;
+	}
+
+	for (unsigned int i = 0; i < nr_property_snapshot; ++i) {
+		if (property_snapshot[i].property == property) {
+			*value = property_snapshot[i].value;
+			return TPM2_RC_SUCCESS;
+		}
+	}
+
+	err("Invalid tagged property (0x%x)\n", property);
+
+	return TPM2_RC_VALUE;
+}
+
 int
 cryptfs_tpm2_capability_in_lockout(bool *in_lockout)
 {
@@ -579,3 +988,25 @@ cryptfs_tpm2_capability_get_lockout_recovery(UINT32 *recovery)
 
 	return EXIT_FAILURE;
 }
+
+/*
+ * The cheapest command to confirm TPM is able to respond.
+ */
+int
+cryptfs_tpm2_capability_ping(void)
+{
+	TPMI_YES_NO more_data;
+	TPMS_CAPABILITY_DATA capability_data;
+	UINT32 rc;
+
+	rc = Tss2_Sys_GetCapability(tss2_sys_context(), NULL,
+				    TPM2_CAP_TPM_PROPERTIES,
+				    TPM2_PT_MANUFACTURER, 1, &more_data,
+				    &capability_data, NULL);
+	if (rc != TPM2_RC_SUCCESS) {
+		dbg("Unable to ping TPM (%#x)\n", rc);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
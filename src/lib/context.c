@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2024, Alibaba Cloud
+ * Copyright (c) 2016-2023, Wind River Systems, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1) Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2) Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3) Neither the name of Wind River Systems nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author:
+ *        Jia Zhang <zhang.jia@linux.alibaba.com>
+ */
+
+#include <cryptfs_tpm2.h>
+
+#include "internal.h"
+
+/*
+ * Track the transient objects and sessions loaded by libcryptfs-tpm2, so
+ * they are always flushed even if the caller bails out early. Without a
+ * resource manager, e.g, /dev/tpm0, nothing else flushes them and TPM
+ * runs out of the object or session slots soon.
+ */
+
+/* Far more than the slots of TPM */
+#define MAX_CONTEXTS		16
+
+static struct {
+	TPM2_HANDLE handle;
+	unsigned long last_used;
+} contexts[MAX_CONTEXTS];
+static unsigned long context_clock;
+static pthread_mutex_t context_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+lookup_context(TPM2_HANDLE handle)
+{
+	for (int i = 0; i < MAX_CONTEXTS; ++i) {
+		if (contexts[i].handle == handle)
+			return i;
+	}
+
+	return -1;
+}
+
+static void
+untrack_context(TPM2_HANDLE handle)
+{
+	pthread_mutex_lock(&context_lock);
+
+	int i = lookup_context(handle);
+	if (i >= 0)
+		contexts[i].handle = 0;
+
+	pthread_mutex_unlock(&context_lock);
+}
+
+static int
+flush_context(TSS2_SYS_CONTEXT *sys_context, TPM2_HANDLE handle)
+{
+	UINT32 rc;
+
+	rc = Tss2_Sys_FlushContext(sys_context, handle);
+	if (rc != TPM2_RC_SUCCESS) {
+		err("Unable to flush the context %#8.8x (%#x)\n", handle, rc);
+		return -1;
+	}
+
+	dbg("The context %#8.8x flushed\n", handle);
+
+	return 0;
+}
+
+void
+context_track(TPM2_HANDLE handle)
+{
+	pthread_mutex_lock(&context_lock);
+
+	int i = lookup_context(handle);
+	if (i < 0)
+		i = lookup_context(0);
+
+	if (i >= 0) {
+		contexts[i].handle = handle;
+		contexts[i].last_used = ++context_clock;
+	} else
+		warn("Unable to track the context %#8.8x\n", handle);
+
+	pthread_mutex_unlock(&context_lock);
+}
+
+void
+context_touch(TPM2_HANDLE handle)
+{
+	pthread_mutex_lock(&context_lock);
+
+	int i = lookup_context(handle);
+	if (i >= 0)
+		contexts[i].last_used = ++context_clock;
+
+	pthread_mutex_unlock(&context_lock);
+}
+
+int
+context_flush(TPM2_HANDLE handle)
+{
+	untrack_context(handle);
+
+	return flush_context(tss2_sys_context(), handle);
+}
+
+/*
+ * Called with the system context being torn down, so it cannot be
+ * retrieved via tss2_sys_context() any more.
+ */
+void
+context_flush_all(TSS2_SYS_CONTEXT *sys_context)
+{
+	pthread_mutex_lock(&context_lock);
+
+	for (int i = 0; i < MAX_CONTEXTS; ++i) {
+		if (!contexts[i].handle)
+			continue;
+
+		flush_context(sys_context, contexts[i].handle);
+		contexts[i].handle = 0;
+	}
+
+	pthread_mutex_unlock(&context_lock);
+}
+
+/*
+ * If TPM runs out of the object or session memory or handles, evict the least
+ * recently used context of the same kind. Return true if the failed
+ * command is worth retrying.
+ */
+bool
+context_reclaim(TSS2_RC rc)
+{
+	UINT8 type;
+
+	if (rc == TPM2_RC_OBJECT_MEMORY || rc == TPM2_RC_OBJECT_HANDLES)
+		type = TPM2_HT_TRANSIENT;
+	else if (rc == TPM2_RC_SESSION_MEMORY ||
+		 rc == TPM2_RC_SESSION_HANDLES)
+		type = TPM2_HT_POLICY_SESSION;
+	else
+		return false;
+
+	pthread_mutex_lock(&context_lock);
+
+	int lru = -1;
+
+	for (int i = 0; i < MAX_CONTEXTS; ++i) {
+		TPM2_HANDLE handle = contexts[i].handle;
+		UINT8 handle_type = handle >> TPM2_HR_SHIFT;
+
+		if (!handle)
+			continue;
+
+		/* The HMAC and policy sessions share the session memory */
+		if (handle_type == TPM2_HT_HMAC_SESSION)
+			handle_type = TPM2_HT_POLICY_SESSION;
+
+		if (handle_type != type)
+			continue;
+
+		if (lru < 0 || contexts[i].last_used < contexts[lru].last_used)
+			lru = i;
+	}
+
+	TPM2_HANDLE handle = 0;
+
+	if (lru >= 0) {
+		handle = contexts[lru].handle;
+		contexts[lru].handle = 0;
+	}
+
+	pthread_mutex_unlock(&context_lock);
+
+	if (!handle) {
+		dbg("No context can be evicted to reclaim the %s memory\n",
+		    type == TPM2_HT_TRANSIENT ? "object" : "session");
+		return false;
+	}
+
+	info("Evicting the least recently used context %#8.8x\n", handle);
+
+	return !flush_context(tss2_sys_context(), handle);
+}
@@ -37,8 +37,9 @@
 #include "internal.h"
 
 static int
-calc_policy_digest(TPML_PCR_SELECTION *pcrs, TPMI_ALG_HASH policy_digest_alg,
-		   TPM2B_DIGEST *policy_digest)
+calc_trial_policy_digest(TPML_PCR_SELECTION *pcrs,
+			 TPMI_ALG_HASH policy_digest_alg,
+			 TPM2B_DIGEST *policy_digest)
 {
 #ifndef TSS2_LEGACY_V1
 	if (util_digest_size(policy_digest_alg, &policy_digest->size))
@@ -62,7 +63,7 @@ calc_policy_digest(TPML_PCR_SELECTION *pcrs, TPMI_ALG_HASH policy_digest_alg,
 		return -1;
 	}
 
-	UINT32 rc = Tss2_Sys_PolicyGetDigest(cryptfs_tpm2_sys_context,
+	UINT32 rc = Tss2_Sys_PolicyGetDigest(tss2_sys_context(),
 					     s.session_handle, NULL,
 					     policy_digest, NULL);
 	policy_session_destroy(&s);
@@ -74,6 +75,71 @@ calc_policy_digest(TPML_PCR_SELECTION *pcrs, TPMI_ALG_HASH policy_digest_alg,
 	return 0;
 }
 
+/*
+ * The policy digest is deterministic so it is calculated on the host
+ * with the PCR values read from TPM, instead of a trial session.
+ */
+static int
+calc_policy_digest(TPML_PCR_SELECTION *pcrs, TPMI_ALG_HASH policy_digest_alg,
+		   TPM2B_DIGEST *policy_digest)
+{
+	TPML_PCR_SELECTION pcrs_out;
+	TPML_DIGEST pcr_values;
+
+	if (capability_read_voted_pcr(pcrs, &pcrs_out, &pcr_values) &&
+	    pcr_read(pcrs, &pcrs_out, &pcr_values))
+		return -1;
+
+	if (policy_digest_init(policy_digest_alg, policy_digest))
+		return -1;
+
+	if (pcr_policy_calc(policy_digest_alg, policy_digest, &pcrs_out,
+			    &pcr_values))
+		return -1;
+
+	if (password_policy_calc(policy_digest_alg, policy_digest))
+		return -1;
+
+	if (option_check_policy == false)
+		return 0;
+
+	TPM2B_DIGEST trial_digest;
+
+	if (calc_trial_policy_digest(pcrs, policy_digest_alg, &trial_digest))
+		return -1;
+
+#ifndef TSS2_LEGACY_V1
+	if (trial_digest.size != policy_digest->size ||
+	    memcmp(trial_digest.buffer, policy_digest->buffer,
+		   policy_digest->size)) {
+		cryptfs_tpm2_util_hex_dump("host policy digest",
+					   policy_digest->buffer,
+					   policy_digest->size);
+		cryptfs_tpm2_util_hex_dump("trial policy digest",
+					   trial_digest.buffer,
+					   trial_digest.size);
+#else
+	if (trial_digest.t.size != policy_digest->t.size ||
+	    memcmp(trial_digest.t.buffer, policy_digest->t.buffer,
+		   policy_digest->t.size)) {
+		cryptfs_tpm2_util_hex_dump("host policy digest",
+					   policy_digest->t.buffer,
+					   policy_digest->t.size);
+		cryptfs_tpm2_util_hex_dump("trial policy digest",
+					   trial_digest.t.buffer,
+					   trial_digest.t.size);
+#endif
+		err("The policy digest calculated on the host mismatches "
+		    "the one from the trial session\n");
+		return -1;
+	}
+
+	info("The policy digest calculated on the host matches the one "
+	     "from the trial session\n");
+
+	return 0;
+}
+
 static int
 set_public(TPMI_ALG_PUBLIC type, TPMI_ALG_HASH name_alg, int set_key,
 	   size_t sensitive_size, TPM2B_PUBLIC *inPublic,
@@ -251,13 +317,57 @@ set_public(TPMI_ALG_PUBLIC type, TPMI_ALG_HASH name_alg, int set_key,
 	return 0;
 }
 
+/*
+ * Check the persistent handle up front to avoid creating an object which
+ * cannot be persisted anyway.
+ */
+static int
+check_persistent_handle(TPMI_DH_OBJECT handle, const char *obj_name)
+{
+	TPM2B_PUBLIC public;
+	int rc;
+
+	rc = capability_read_public(handle, &public);
+	if (rc < 0)
+		return -1;
+
+	if (!rc) {
+		err("The %s object already exists with the handle value: "
+		    "%#8.8x\n", obj_name, handle);
+		return -1;
+	}
+
+	return 0;
+}
+
 int
-cryptfs_tpm2_create_primary_key(TPMI_ALG_HASH pcr_bank_alg)
+cryptfs_tpm2_create_primary_key(TPMI_ALG_HASH pcr_bank_alg,
+				TPMI_ALG_PUBLIC key_type)
 {
 	TPML_PCR_SELECTION creation_pcrs;
 	TPM2B_DIGEST policy_digest;
 	TPMI_ALG_HASH name_alg;
 
+	if (check_persistent_handle(CRYPTFS_TPM2_PRIMARY_KEY_HANDLE,
+				    "primary key"))
+		return -1;
+
+	/*
+	 * Generating a NIST P-256 key takes far less time than searching
+	 * the primes of a RSA 2048-bit key, so prefer it if available.
+	 */
+	if (key_type == TPM2_ALG_NULL)
+		key_type = cryptfs_tpm2_capability_ecc_p256_supported() ==
+			   true ? TPM2_ALG_ECC : TPM2_ALG_RSA;
+
+	if (key_type != TPM2_ALG_RSA && key_type != TPM2_ALG_ECC) {
+		err("Unsupported primary key type %#x\n", key_type);
+		return -1;
+	}
+
+	dbg("Creating the %s primary key ...\n",
+	    key_type == TPM2_ALG_ECC ? "ECC NIST P-256" : "RSA 2048-bit");
+
 	if (pcr_bank_alg != TPM2_ALG_NULL) {
 		unsigned int pcr_index = CRYPTFS_TPM2_PCR_INDEX;
 
@@ -286,7 +396,7 @@ cryptfs_tpm2_create_primary_key(TPMI_ALG_HASH pcr_bank_alg)
 	}
 
 	TPM2B_PUBLIC in_public;
-	if (set_public(TPM2_ALG_RSA, name_alg, 1, 0, &in_public,
+	if (set_public(key_type, name_alg, 1, 0, &in_public,
 		       &policy_digest))
 		return -1;
 
@@ -337,7 +447,7 @@ cryptfs_tpm2_create_primary_key(TPMI_ALG_HASH pcr_bank_alg)
 redo:
 	password_session_create(&s, (char *)owner_auth, owner_auth_size);
 
-	rc = Tss2_Sys_CreatePrimary(cryptfs_tpm2_sys_context,
+	rc = Tss2_Sys_CreatePrimary(tss2_sys_context(),
 				    TPM2_RH_OWNER, &s.sessionsData,
 				    &in_sensitive, &in_public,
 				    &outside_info, &creation_pcrs,
@@ -346,6 +456,9 @@ redo:
 				    &creation_ticket, &out_name,
 				    &s.sessionsDataOut);
 	if (rc != TPM2_RC_SUCCESS) {
+		if (context_reclaim(rc) == true)
+			goto redo;
+
 		if (rc == TPM2_RC_LOCKOUT) {
 			if (da_reset() == EXIT_SUCCESS)
 				goto redo;
@@ -372,29 +485,220 @@ redo:
 	 */
 	cryptfs_tpm2_option_set_owner_auth(owner_auth, &owner_auth_size);
 
+	context_track(obj_handle);
+
 	dbg("Preparing to persist the primary key object ...\n");
 
 	rc = cryptfs_tpm2_persist_primary_key(obj_handle);
+	/* The transient object is no longer needed anyway */
+	context_flush(obj_handle);
 	if (rc != TPM2_RC_SUCCESS) {
         	err("Unable to persist the primary key\n");
 		return -1;
 	}
 
+	capability_cache_public(CRYPTFS_TPM2_PRIMARY_KEY_HANDLE, &out_public);
+
 	info("Succeed to create and load the primary key with the "
-	     "handle value: %#8.8x\n", obj_handle);
+	     "handle value: %#8.8x\n", CRYPTFS_TPM2_PRIMARY_KEY_HANDLE);
 
 	return 0;
 }
 
 int
-cryptfs_tpm2_create_passphrase(char *passphrase, size_t passphrase_size,
-			       TPMI_ALG_HASH pcr_bank_alg)
+cryptfs_tpm2_select_parent(cryptfs_tpm2_parent_t mode, TPMI_DH_OBJECT *parent)
+{
+	*parent = CRYPTFS_TPM2_PRIMARY_KEY_HANDLE;
+
+	if (mode == CRYPTFS_TPM2_PARENT_KEY)
+		return 0;
+
+	if (cryptfs_tpm2_capability_srk_compatible() == true) {
+		info("Reusing the SRK with the handle value: %#8.8x\n",
+		     CRYPTFS_TPM2_SRK_HANDLE);
+		*parent = CRYPTFS_TPM2_SRK_HANDLE;
+		return 0;
+	}
+
+	if (mode == CRYPTFS_TPM2_PARENT_SRK) {
+		err("No compatible SRK with the handle value: %#8.8x\n",
+		    CRYPTFS_TPM2_SRK_HANDLE);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Store the passphrase in the NV index, which is read with a single
+ * TPM2_NV_Read, without the parent and the sealed object at all.
+ */
+static int
+define_nv_passphrase(char *passphrase, size_t passphrase_size,
+		     TPMI_ALG_HASH name_alg, TPM2B_DIGEST *policy_digest)
+{
+	char secret[CRYPTFS_TPM2_SECRET_MAX_SIZE];
+	unsigned int secret_size = sizeof(secret);
+
+	get_passphrase_secret(secret, &secret_size);
+
+	TPM2B_AUTH auth;
+	TPM2B_NV_PUBLIC public_info;
+	TPM2B_MAX_NV_BUFFER nv_data;
+
+	memset(&public_info, 0, sizeof(public_info));
+	memset(&nv_data, 0, sizeof(nv_data));
+
+#ifndef TSS2_LEGACY_V1
+	auth.size = secret_size;
+	memcpy(auth.buffer, secret, auth.size);
+
+	TPMS_NV_PUBLIC *nv_public = &public_info.nvPublic;
+
+	nv_public->nvIndex = CRYPTFS_TPM2_NV_INDEX;
+	nv_public->nameAlg = name_alg;
+	/* Write once at seal time */
+	nv_public->attributes = TPMA_NV_AUTHWRITE | TPMA_NV_WRITEDEFINE;
+	/* PolicyPCR and PolicyPassword if bound to PCR */
+	if (policy_digest->size) {
+		nv_public->attributes |= TPMA_NV_POLICYREAD;
+		nv_public->authPolicy = *policy_digest;
+	} else
+		nv_public->attributes |= TPMA_NV_AUTHREAD;
+	if (option_no_da)
+		nv_public->attributes |= TPMA_NV_NO_DA;
+	nv_public->dataSize = CRYPTFS_TPM2_NV_SIZE;
+	public_info.size = sizeof(nv_public->nvIndex) +
+			   sizeof(nv_public->nameAlg) +
+			   sizeof(nv_public->attributes) +
+			   sizeof(nv_public->authPolicy.size) +
+			   nv_public->authPolicy.size +
+			   sizeof(nv_public->dataSize);
+
+	nv_data.size = CRYPTFS_TPM2_NV_SIZE;
+	nv_data.buffer[0] = passphrase_size >> 8;
+	nv_data.buffer[1] = passphrase_size;
+	memcpy(nv_data.buffer + 2, passphrase, passphrase_size);
+#else
+	auth.t.size = secret_size;
+	memcpy(auth.t.buffer, secret, auth.t.size);
+
+	TPMS_NV_PUBLIC *nv_public = &public_info.t.nvPublic;
+
+	nv_public->nvIndex = CRYPTFS_TPM2_NV_INDEX;
+	nv_public->nameAlg = name_alg;
+	nv_public->attributes.TPMA_NV_AUTHWRITE = 1;
+	nv_public->attributes.TPMA_NV_WRITEDEFINE = 1;
+	if (policy_digest->t.size) {
+		nv_public->attributes.TPMA_NV_POLICYREAD = 1;
+		nv_public->authPolicy = *policy_digest;
+	} else
+		nv_public->attributes.TPMA_NV_AUTHREAD = 1;
+	nv_public->attributes.TPMA_NV_NO_DA = !!option_no_da;
+	nv_public->dataSize = CRYPTFS_TPM2_NV_SIZE;
+	public_info.t.size = sizeof(nv_public->nvIndex) +
+			     sizeof(nv_public->nameAlg) +
+			     sizeof(nv_public->attributes) +
+			     sizeof(nv_public->authPolicy.t.size) +
+			     nv_public->authPolicy.t.size +
+			     sizeof(nv_public->dataSize);
+
+	nv_data.t.size = CRYPTFS_TPM2_NV_SIZE;
+	nv_data.t.buffer[0] = passphrase_size >> 8;
+	nv_data.t.buffer[1] = passphrase_size;
+	memcpy(nv_data.t.buffer + 2, passphrase, passphrase_size);
+#endif
+	uint8_t owner_auth[sizeof(TPMU_HA)];
+	unsigned int owner_auth_size = sizeof(owner_auth);
+
+	if (cryptfs_tpm2_option_get_owner_auth(owner_auth, &owner_auth_size))
+		return -1;
+
+	struct session_complex s;
+	UINT32 rc;
+
+re_auth_owner:
+	password_session_create(&s, (char *)owner_auth, owner_auth_size);
+redo:
+	rc = Tss2_Sys_NV_DefineSpace(tss2_sys_context(), TPM2_RH_OWNER,
+				     &s.sessionsData, &auth, &public_info,
+				     &s.sessionsDataOut);
+	if (rc != TPM2_RC_SUCCESS) {
+		if (rc == TPM2_RC_LOCKOUT) {
+			if (da_reset() == EXIT_SUCCESS)
+				goto redo;
+		} else if (tpm2_rc_is_format_one(rc) &&
+			   (tpm2_rc_get_code_7bit(rc) | TPM2_RC_FMT1) ==
+			   TPM2_RC_BAD_AUTH) {
+			owner_auth_size = sizeof(owner_auth);
+
+			if (cryptfs_tpm2_util_get_owner_auth(owner_auth,
+							     &owner_auth_size) ==
+							     EXIT_SUCCESS)
+				goto re_auth_owner;
+		} else if (rc == TPM2_RC_NV_DEFINED) {
+			err("The passphrase NV index already exists with the "
+			    "index value: %#8.8x\n", CRYPTFS_TPM2_NV_INDEX);
+			goto out;
+		}
+
+		err("Unable to define the passphrase NV index (%#x)\n", rc);
+		goto out;
+	}
+
+	cryptfs_tpm2_option_set_owner_auth(owner_auth, &owner_auth_size);
+
+	dbg("Preparing to write the passphrase NV index ...\n");
+
+	password_session_create(&s, secret, secret_size);
+
+	rc = Tss2_Sys_NV_Write(tss2_sys_context(), CRYPTFS_TPM2_NV_INDEX,
+			       CRYPTFS_TPM2_NV_INDEX, &s.sessionsData,
+			       &nv_data, 0, &s.sessionsDataOut);
+	if (rc == TPM2_RC_SUCCESS)
+		rc = Tss2_Sys_NV_WriteLock(tss2_sys_context(),
+					   CRYPTFS_TPM2_NV_INDEX,
+					   CRYPTFS_TPM2_NV_INDEX,
+					   &s.sessionsData,
+					   &s.sessionsDataOut);
+	if (rc != TPM2_RC_SUCCESS) {
+		err("Unable to write the passphrase NV index (%#x)\n", rc);
+		/* Don't leave a defined but unusable NV index */
+		cryptfs_tpm2_evict_passphrase();
+		goto out;
+	}
+
+	info("Succeed to store the passphrase in the NV index with the "
+	     "index value: %#8.8x\n", CRYPTFS_TPM2_NV_INDEX);
+
+out:
+	/* Don't leave a copy of the secret on the stack */
+	memset(&nv_data, 0, sizeof(nv_data));
+	memset(&auth, 0, sizeof(auth));
+	memset(secret, 0, sizeof(secret));
+
+	return rc == TPM2_RC_SUCCESS ? 0 : -1;
+}
+
+/*
+ * The passphrase object is exported as a blob if requested, instead of
+ * being loaded and persisted.
+ */
+static int
+create_passphrase(char *passphrase, size_t passphrase_size,
+		  TPMI_ALG_HASH pcr_bank_alg, TPMI_DH_OBJECT parent,
+		  void **blob, size_t *blob_size)
 {
 	TPML_PCR_SELECTION creation_pcrs;
 	TPM2B_DIGEST policy_digest;
 	TPMI_ALG_HASH name_alg;
 	char fixed_passphrase[CRYPTFS_TPM2_PASSPHRASE_MAX_SIZE];
 
+	if (!blob && option_nv == false &&
+	    check_persistent_handle(CRYPTFS_TPM2_PASSPHRASE_HANDLE,
+				    "passphrase"))
+		return -1;
+
 	if (pcr_bank_alg != TPM2_ALG_NULL) {
 		unsigned int pcr_index = CRYPTFS_TPM2_PCR_INDEX;
 
@@ -443,6 +747,10 @@ cryptfs_tpm2_create_passphrase(char *passphrase, size_t passphrase_size,
 		passphrase = fixed_passphrase;
 	}
 
+	if (option_nv == true)
+		return define_nv_passphrase(passphrase, passphrase_size,
+					    name_alg, &policy_digest);
+
 	TPM2B_PUBLIC in_public;
 
 	if (set_public(TPM2_ALG_KEYEDHASH, name_alg, 0, passphrase_size,
@@ -487,26 +795,64 @@ cryptfs_tpm2_create_passphrase(char *passphrase, size_t passphrase_size,
 	TPM2B_PUBLIC out_public = { { 0, } };
 	TPM2B_PRIVATE out_private = { { sizeof(TPM2B_PRIVATE) - 2, } };
 #endif
+#ifndef TSS2_LEGACY_V1
+	TPM2B_NAME name_ext = { sizeof(TPM2B_NAME) - 2, };
+	TPM2B_TEMPLATE in_template = { 0, };
+#else
+	TPM2B_NAME name_ext = { { sizeof(TPM2B_NAME) - 2, } };
+#endif
+	TPM2_HANDLE obj_handle;
+	bool create_loaded = false;
 	struct session_complex s;
 
+#ifndef TSS2_LEGACY_V1
+	/* TPM2_CreateLoaded saves the round trip of TPM2_Load */
+	if (!blob && option_no_create_loaded == false &&
+	    cryptfs_tpm2_capability_command_supported(TPM2_CC_CreateLoaded) ==
+	    true)
+		create_loaded = !sealed_public_marshal(&in_public.publicArea,
+						       in_template.buffer,
+						       &in_template.size);
+#endif
+
+	dbg("%s TPM2_CreateLoaded to create the passphrase object\n",
+	    create_loaded == true ? "Using" : "Not using");
+
 re_auth_pkey:
 	secret_size = sizeof(secret);
-	get_primary_key_secret(secret, &secret_size);
+	/* The SRK is created with the empty authorization by TCG template */
+	if (parent == CRYPTFS_TPM2_SRK_HANDLE)
+		secret_size = 0;
+	else
+		get_primary_key_secret(secret, &secret_size);
 redo:
 	password_session_create(&s, (char *)secret, secret_size);
 
-	rc = Tss2_Sys_Create(cryptfs_tpm2_sys_context,
-			     CRYPTFS_TPM2_PRIMARY_KEY_HANDLE,
-			     &s.sessionsData, &in_sensitive, &in_public,
-			     &outside_info, &creation_pcrs,
-			     &out_private, &out_public, &creation_data,
-			     &creation_hash, &creation_ticket,
-			     &s.sessionsDataOut);
+#ifndef TSS2_LEGACY_V1
+	if (create_loaded == true)
+		rc = Tss2_Sys_CreateLoaded(tss2_sys_context(), parent,
+					   &s.sessionsData, &in_sensitive,
+					   &in_template, &obj_handle,
+					   &out_private, &out_public,
+					   &name_ext, &s.sessionsDataOut);
+	else
+#endif
+		rc = Tss2_Sys_Create(tss2_sys_context(), parent,
+				     &s.sessionsData, &in_sensitive,
+				     &in_public, &outside_info,
+				     &creation_pcrs, &out_private,
+				     &out_public, &creation_data,
+				     &creation_hash, &creation_ticket,
+				     &s.sessionsDataOut);
 	if (rc != TPM2_RC_SUCCESS) {
+		if (context_reclaim(rc) == true)
+			goto redo;
+
 		if (rc == TPM2_RC_LOCKOUT) {
 			if (da_reset() == EXIT_SUCCESS)
 				goto re_auth_pkey;
-		} else if (tpm2_rc_is_format_one(rc) &&
+		} else if (parent == CRYPTFS_TPM2_PRIMARY_KEY_HANDLE &&
+			   tpm2_rc_is_format_one(rc) &&
 			   (((tpm2_rc_get_code_7bit(rc) | TPM2_RC_FMT1) ==
 			   TPM2_RC_BAD_AUTH) ||
 			   ((tpm2_rc_get_code_7bit(rc) | TPM2_RC_FMT1) ==
@@ -525,35 +871,83 @@ redo:
 		return -1;
 	}
 
-	dbg("Preparing to load the passphrase object ...\n");
-
 #ifndef TSS2_LEGACY_V1
-	TPM2B_NAME name_ext = { sizeof(TPM2B_NAME) - 2, };
-#else
-	TPM2B_NAME name_ext = { { sizeof(TPM2B_NAME) - 2, } };
+	if (blob) {
+		if (blob_marshal(parent, &out_private, &out_public, blob,
+				 blob_size))
+			return -1;
+
+		info("Succeed to export the passphrase object (%zu-byte)\n",
+		     *blob_size);
+
+		return 0;
+	}
 #endif
-	TPM2_HANDLE obj_handle;
 
-	rc = Tss2_Sys_Load(cryptfs_tpm2_sys_context,
-			   CRYPTFS_TPM2_PRIMARY_KEY_HANDLE, &s.sessionsData,
-			   &out_private, &out_public, &obj_handle, &name_ext,
-			   &s.sessionsDataOut);
-	if (rc != TPM2_RC_SUCCESS) {
-        	err("Unable to load the passphrase object (%#x)\n", rc);
-		return -1;
+	if (create_loaded == false) {
+		dbg("Preparing to load the passphrase object ...\n");
+reload:
+		rc = Tss2_Sys_Load(tss2_sys_context(), parent,
+				   &s.sessionsData, &out_private, &out_public,
+				   &obj_handle, &name_ext, &s.sessionsDataOut);
+		if (rc != TPM2_RC_SUCCESS) {
+			if (context_reclaim(rc) == true)
+				goto reload;
+
+			err("Unable to load the passphrase object (%#x)\n",
+			    rc);
+			return -1;
+		}
 	}
 
+	context_track(obj_handle);
+
 	dbg("Preparing to persiste the passphrase object ...\n");
 
-	/* XXX: check whether already persisted. TPM2_RC_NV_DEFINED (0x14c) */
 	rc = cryptfs_tpm2_persist_passphrase(obj_handle);
+	context_flush(obj_handle);
 	if (rc != TPM2_RC_SUCCESS) {
 		err("Unable to persist the passphrase object\n");
 		return -1;
 	}
 
+	capability_cache_public(CRYPTFS_TPM2_PASSPHRASE_HANDLE, &out_public);
+
 	info("Succeed to create and load the passphrase object with the "
-	     "handle value: %#8.8x\n", obj_handle);
+	     "handle value: %#8.8x\n", CRYPTFS_TPM2_PASSPHRASE_HANDLE);
 
 	return 0;
 }
+
+int
+cryptfs_tpm2_create_passphrase(char *passphrase, size_t passphrase_size,
+			       TPMI_ALG_HASH pcr_bank_alg,
+			       TPMI_DH_OBJECT parent)
+{
+	return create_passphrase(passphrase, passphrase_size, pcr_bank_alg,
+				 parent, NULL, NULL);
+}
+
+/*
+ * Export the passphrase object as a blob, which doesn't occupy any
+ * persistent handle. It is unsealed by cryptfs_tpm2_unseal_passphrase_blob().
+ */
+int
+cryptfs_tpm2_create_passphrase_blob(char *passphrase, size_t passphrase_size,
+				    TPMI_ALG_HASH pcr_bank_alg,
+				    TPMI_DH_OBJECT parent, void **blob,
+				    size_t *blob_size)
+{
+#ifndef TSS2_LEGACY_V1
+	if (option_nv == true) {
+		err("The passphrase in the NV index cannot be exported\n");
+		return -1;
+	}
+
+	return create_passphrase(passphrase, passphrase_size, pcr_bank_alg,
+				 parent, blob, blob_size);
+#else
+	err("Exporting the passphrase object is not supported\n");
+	return -1;
+#endif
+}
@@ -52,7 +52,7 @@ clear_lockout(const char *lockout_auth)
 
 	UINT32 rc;
 
-	rc = Tss2_Sys_DictionaryAttackLockReset(cryptfs_tpm2_sys_context,
+	rc = Tss2_Sys_DictionaryAttackLockReset(tss2_sys_context(),
 						TPM2_RH_LOCKOUT,
 						&s.sessionsData,
 						&s.sessionsDataOut);
@@ -75,13 +75,16 @@ clear_lockout(const char *lockout_auth)
 		return EXIT_FAILURE;
 	}
 
+	/* The lockout counter and inLockout are changed */
+	cryptfs_tpm2_capability_invalidate();
+
 	info("Reset DA lockout\n");
 
         return EXIT_SUCCESS;
 }
 
-int
-da_reset(void)
+static int
+do_da_reset(void)
 {
 	UINT32 counter;
 	int rc;
@@ -196,6 +199,15 @@ out:
 	return rc;
 }
 
+int
+da_reset(void)
+{
+	/* The failed authorization has changed the lockout counter */
+	cryptfs_tpm2_capability_invalidate();
+
+	return do_da_reset();
+}
+
 int
 da_check_and_reset(void)
 {
@@ -204,7 +216,7 @@ da_check_and_reset(void)
 
 	rc = cryptfs_tpm2_capability_in_lockout(&in_lockout);
 	if (rc == EXIT_SUCCESS && in_lockout == true)
-		rc = da_reset();
+		rc = do_da_reset();
 
 	return rc;
 }
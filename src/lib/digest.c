@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2024, Alibaba Cloud
+ * Copyright (c) 2016-2023, Wind River Systems, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1) Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2) Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3) Neither the name of Wind River Systems nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author:
+ *        Jia Zhang <zhang.jia@linux.alibaba.com>
+ */
+
+/*
+ * The host-side digest engine.
+ *
+ * All digests required by cryptfs-tpm2 are small (a few PCR values or a
+ * policy digest chain) so computing them on the host is far cheaper than
+ * a round-trip to the TPM through the bus.
+ */
+
+#include <cryptfs_tpm2.h>
+
+#include "internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define HAVE_SHA_NI
+#endif
+
+typedef void (*digest_block_fn)(void *state, const uint8_t *data,
+				size_t nr_block);
+
+typedef struct {
+	TPMI_ALG_HASH alg;
+	/* The size of message block in byte */
+	unsigned int block_size;
+	/* The size of length field appended in the last block */
+	unsigned int length_size;
+	/* The size of state word, 4 or 8 */
+	unsigned int word_size;
+	unsigned int digest_size;
+	const void *iv;
+	/* The size of initial hash value in byte */
+	unsigned int iv_size;
+	digest_block_fn block;
+} digest_desc_t;
+
+#define rol32(x, n)	(((x) << ((n) & 31)) | ((x) >> ((32 - ((n) & 31)) & 31)))
+#define ror32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+#define ror64(x, n)	(((x) >> (n)) | ((x) << (64 - (n))))
+
+static inline uint32_t
+load_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t
+load_be64(const uint8_t *p)
+{
+	return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+static inline void
+store_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static inline void
+store_be64(uint8_t *p, uint64_t v)
+{
+	store_be32(p, v >> 32);
+	store_be32(p + 4, (uint32_t)v);
+}
+
+static const uint32_t sha1_iv[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static void
+sha1_block_generic(void *state, const uint8_t *data, size_t nr_block)
+{
+	uint32_t *h = state;
+
+	while (nr_block--) {
+		uint32_t w[80];
+		unsigned int i;
+
+		for (i = 0; i < 16; ++i)
+			w[i] = load_be32(data + i * 4);
+		for (; i < 80; ++i)
+			w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^
+				     w[i - 16], 1);
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+		for (i = 0; i < 80; ++i) {
+			uint32_t f, k;
+
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			} else if (i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+
+			uint32_t t = rol32(a, 5) + f + e + k + w[i];
+
+			e = d;
+			d = c;
+			c = rol32(b, 30);
+			b = a;
+			a = t;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+
+		data += 64;
+	}
+}
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint32_t sha256_k[64] __attribute__((aligned(16))) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void
+sha256_block_generic(void *state, const uint8_t *data, size_t nr_block)
+{
+	uint32_t *h = state;
+
+	while (nr_block--) {
+		uint32_t w[64];
+		unsigned int i;
+
+		for (i = 0; i < 16; ++i)
+			w[i] = load_be32(data + i * 4);
+		for (; i < 64; ++i) {
+			uint32_t s0 = ror32(w[i - 15], 7) ^
+				      ror32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = ror32(w[i - 2], 17) ^
+				      ror32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+		uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+
+		for (i = 0; i < 64; ++i) {
+			uint32_t s1 = ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25);
+			uint32_t ch = (e & f) ^ (~e & g);
+			uint32_t t1 = k + s1 + ch + sha256_k[i] + w[i];
+			uint32_t s0 = ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22);
+			uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+			uint32_t t2 = s0 + maj;
+
+			k = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+		h[5] += f;
+		h[6] += g;
+		h[7] += k;
+
+		data += 64;
+	}
+}
+
+static const uint64_t sha384_iv[8] = {
+	0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL,
+	0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+	0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL,
+	0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL
+};
+
+static const uint64_t sha512_iv[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+	0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+	0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint64_t sha512_k[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+	0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+	0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+	0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+	0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+	0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+	0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+	0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+	0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+	0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+	0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+	0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+	0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+	0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+	0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+	0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+	0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+	0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+	0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+	0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+	0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static void
+sha512_block_generic(void *state, const uint8_t *data, size_t nr_block)
+{
+	uint64_t *h = state;
+
+	while (nr_block--) {
+		uint64_t w[80];
+		unsigned int i;
+
+		for (i = 0; i < 16; ++i)
+			w[i] = load_be64(data + i * 8);
+		for (; i < 80; ++i) {
+			uint64_t s0 = ror64(w[i - 15], 1) ^
+				      ror64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+			uint64_t s1 = ror64(w[i - 2], 19) ^
+				      ror64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		uint64_t a = h[0], b = h[1], c = h[2], d = h[3];
+		uint64_t e = h[4], f = h[5], g = h[6], k = h[7];
+
+		for (i = 0; i < 80; ++i) {
+			uint64_t s1 = ror64(e, 14) ^ ror64(e, 18) ^ ror64(e, 41);
+			uint64_t ch = (e & f) ^ (~e & g);
+			uint64_t t1 = k + s1 + ch + sha512_k[i] + w[i];
+			uint64_t s0 = ror64(a, 28) ^ ror64(a, 34) ^ ror64(a, 39);
+			uint64_t maj = (a & b) ^ (a & c) ^ (b & c);
+			uint64_t t2 = s0 + maj;
+
+			k = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+		h[5] += f;
+		h[6] += g;
+		h[7] += k;
+
+		data += 128;
+	}
+}
+
+static const uint32_t sm3_iv[8] = {
+	0x7380166f, 0x4914b2b9, 0x172442d7, 0xda8a0600,
+	0xa96f30bc, 0x163138aa, 0xe38dee4d, 0xb0fb0e4e
+};
+
+#define sm3_p0(x)	((x) ^ rol32(x, 9) ^ rol32(x, 17))
+#define sm3_p1(x)	((x) ^ rol32(x, 15) ^ rol32(x, 23))
+
+static void
+sm3_block_generic(void *state, const uint8_t *data, size_t nr_block)
+{
+	uint32_t *v = state;
+
+	while (nr_block--) {
+		uint32_t w[68];
+		unsigned int j;
+
+		for (j = 0; j < 16; ++j)
+			w[j] = load_be32(data + j * 4);
+		for (; j < 68; ++j) {
+			uint32_t x = w[j - 16] ^ w[j - 9] ^ rol32(w[j - 3], 15);
+
+			w[j] = sm3_p1(x) ^ rol32(w[j - 13], 7) ^ w[j - 6];
+		}
+
+		uint32_t a = v[0], b = v[1], c = v[2], d = v[3];
+		uint32_t e = v[4], f = v[5], g = v[6], h = v[7];
+
+		for (j = 0; j < 64; ++j) {
+			uint32_t t = j < 16 ? 0x79cc4519 : 0x7a879d8a;
+			uint32_t a12 = rol32(a, 12);
+			uint32_t ss1 = rol32(a12 + e + rol32(t, j), 7);
+			uint32_t ss2 = ss1 ^ a12;
+			uint32_t ff, gg;
+
+			if (j < 16) {
+				ff = a ^ b ^ c;
+				gg = e ^ f ^ g;
+			} else {
+				ff = (a & b) | (a & c) | (b & c);
+				gg = (e & f) | (~e & g);
+			}
+
+			uint32_t tt1 = ff + d + ss2 + (w[j] ^ w[j + 4]);
+			uint32_t tt2 = gg + h + ss1 + w[j];
+
+			d = c;
+			c = rol32(b, 9);
+			b = a;
+			a = tt1;
+			h = g;
+			g = rol32(f, 19);
+			f = e;
+			e = sm3_p0(tt2);
+		}
+
+		v[0] ^= a;
+		v[1] ^= b;
+		v[2] ^= c;
+		v[3] ^= d;
+		v[4] ^= e;
+		v[5] ^= f;
+		v[6] ^= g;
+		v[7] ^= h;
+
+		data += 64;
+	}
+}
+
+#ifdef HAVE_SHA_NI
+/*
+ * SHA-1 and SHA-256 with the Intel SHA extensions. The callers must check
+ * sha_ni_supported() first.
+ */
+__attribute__((target("sha,sse4.1")))
+static void
+sha1_block_sha_ni(void *state, const uint8_t *data, size_t nr_block)
+{
+	uint32_t *h = state;
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+					    0x08090a0b0c0d0e0fULL);
+	__m128i abcd, e0, e1, m[4];
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0x1b);
+	e0 = _mm_set_epi32(h[4], 0, 0, 0);
+
+	while (nr_block--) {
+		__m128i abcd_save = abcd, e0_save = e0;
+
+		for (unsigned int i = 0; i < 4; ++i)
+			m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)),
+						mask);
+
+		/* Rounds 0-3 */
+		e0 = _mm_add_epi32(e0, m[0]);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		/* Rounds 4-79, 4 rounds per group */
+		for (unsigned int g = 1; g < 20; ++g) {
+			__m128i cur = m[g & 3];
+
+#define sha1_ni_round(e_this, e_next, f)	\
+	do {	\
+		e_this = _mm_sha1nexte_epu32(e_this, cur);	\
+		e_next = abcd;	\
+		abcd = _mm_sha1rnds4_epu32(abcd, e_this, f);	\
+	} while (0)
+
+			/* Only a literal is allowed for the round function */
+			switch (((g & 1) << 2) | (g / 5)) {
+			case 0:
+				sha1_ni_round(e0, e1, 0);
+				break;
+			case 1:
+				sha1_ni_round(e0, e1, 1);
+				break;
+			case 2:
+				sha1_ni_round(e0, e1, 2);
+				break;
+			case 3:
+				sha1_ni_round(e0, e1, 3);
+				break;
+			case 4:
+				sha1_ni_round(e1, e0, 0);
+				break;
+			case 5:
+				sha1_ni_round(e1, e0, 1);
+				break;
+			case 6:
+				sha1_ni_round(e1, e0, 2);
+				break;
+			default:
+				sha1_ni_round(e1, e0, 3);
+				break;
+			}
+#undef sha1_ni_round
+
+			/* Schedule the message words for the group g + 1..3 */
+			if (g <= 18 && g >= 3)
+				m[(g + 1) & 3] = _mm_sha1msg2_epu32(m[(g + 1) & 3],
+								    cur);
+			if (g <= 17 && g >= 2)
+				m[(g + 2) & 3] = _mm_xor_si128(m[(g + 2) & 3],
+							       cur);
+			if (g <= 16)
+				m[(g + 3) & 3] = _mm_sha1msg1_epu32(m[(g + 3) & 3],
+								    cur);
+		}
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+
+		data += 64;
+	}
+
+	_mm_storeu_si128((__m128i *)h, _mm_shuffle_epi32(abcd, 0x1b));
+	h[4] = _mm_extract_epi32(e0, 3);
+}
+
+__attribute__((target("sha,sse4.1")))
+static void
+sha256_block_sha_ni(void *state, const uint8_t *data, size_t nr_block)
+{
+	uint32_t *h = state;
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					    0x0405060700010203ULL);
+	__m128i state0, state1, tmp, msg, m[4];
+
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0xb1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(h + 4)),
+				   0x1b);
+	/* ABEF */
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	/* CDGH */
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	while (nr_block--) {
+		__m128i abef_save = state0, cdgh_save = state1;
+
+		for (unsigned int i = 0; i < 4; ++i)
+			m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)),
+						mask);
+
+		for (unsigned int g = 0; g < 16; ++g) {
+			msg = _mm_add_epi32(m[g & 3],
+					    _mm_load_si128((const __m128i *)(sha256_k + g * 4)));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0e);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+			if (g < 12) {
+				tmp = _mm_sha256msg1_epu32(m[g & 3],
+							   m[(g + 1) & 3]);
+				tmp = _mm_add_epi32(tmp,
+						    _mm_alignr_epi8(m[(g + 3) & 3],
+								    m[(g + 2) & 3],
+								    4));
+				m[g & 3] = _mm_sha256msg2_epu32(tmp,
+								m[(g + 3) & 3]);
+			}
+		}
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+
+		data += 64;
+	}
+
+	/* FEBA */
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	/* DCHG */
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	/* DCBA */
+	_mm_storeu_si128((__m128i *)h, _mm_blend_epi16(tmp, state1, 0xf0));
+	/* HGFE */
+	_mm_storeu_si128((__m128i *)(h + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+static bool
+sha_ni_supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+
+	/* SSSE3 and SSE4.1 */
+	if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return false;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return false;
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+	return !!(ebx & bit_SHA);
+}
+#endif
+
+static digest_desc_t digest_list[] = {
+	{
+		TPM2_ALG_SHA1, 64, 8, 4, TPM2_SHA1_DIGEST_SIZE,
+		sha1_iv, sizeof(sha1_iv), sha1_block_generic
+	},
+	{
+		TPM2_ALG_SHA256, 64, 8, 4, TPM2_SHA256_DIGEST_SIZE,
+		sha256_iv, sizeof(sha256_iv), sha256_block_generic
+	},
+	{
+		TPM2_ALG_SHA384, 128, 16, 8, TPM2_SHA384_DIGEST_SIZE,
+		sha384_iv, sizeof(sha384_iv), sha512_block_generic
+	},
+	{
+		TPM2_ALG_SHA512, 128, 16, 8, TPM2_SHA512_DIGEST_SIZE,
+		sha512_iv, sizeof(sha512_iv), sha512_block_generic
+	},
+	{
+		TPM2_ALG_SM3_256, 64, 8, 4, TPM2_SM3_256_DIGEST_SIZE,
+		sm3_iv, sizeof(sm3_iv), sm3_block_generic
+	},
+	{
+		TPM2_ALG_NULL,
+	}
+};
+
+static pthread_once_t digest_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Select the block functions once for all threads. The digest list is
+ * never modified after that.
+ */
+static void
+select_block_fn(void)
+{
+#ifdef HAVE_SHA_NI
+	if (sha_ni_supported()) {
+		digest_list[0].block = sha1_block_sha_ni;
+		digest_list[1].block = sha256_block_sha_ni;
+
+		dbg("SHA-NI is used to accelerate SHA-1/SHA-256\n");
+	}
+#endif
+}
+
+static const digest_desc_t *
+find_digest(TPMI_ALG_HASH hash_alg)
+{
+	pthread_once(&digest_once, select_block_fn);
+
+	for (unsigned int i = 0; digest_list[i].alg != TPM2_ALG_NULL; ++i) {
+		if (digest_list[i].alg == hash_alg)
+			return digest_list + i;
+	}
+
+	return NULL;
+}
+
+int
+host_digest(TPMI_ALG_HASH hash_alg, const BYTE *data, UINT32 data_len,
+	    BYTE *hash)
+{
+	const digest_desc_t *desc = find_digest(hash_alg);
+
+	if (!desc) {
+		err("Unsupported host digest algorithm %#x\n", hash_alg);
+		return -1;
+	}
+
+	union {
+		uint32_t w32[8];
+		uint64_t w64[8];
+	} state;
+
+	memcpy(&state, desc->iv, desc->iv_size);
+
+	size_t nr_block = data_len / desc->block_size;
+
+	if (nr_block)
+		desc->block(&state, data, nr_block);
+
+	/* Pad the remainder with 0x80, zeros and the bit length */
+	uint8_t tail[256];
+	unsigned int rem = data_len % desc->block_size;
+	unsigned int tail_size = desc->block_size;
+
+	if (rem + 1 + desc->length_size > desc->block_size)
+		tail_size *= 2;
+
+	memset(tail, 0, tail_size);
+	memcpy(tail, data + nr_block * desc->block_size, rem);
+	tail[rem] = 0x80;
+	/* The higher 64 bits of 128-bit length are always zero */
+	store_be64(tail + tail_size - 8, (uint64_t)data_len * 8);
+
+	desc->block(&state, tail, tail_size / desc->block_size);
+
+	for (unsigned int i = 0; i < desc->digest_size / desc->word_size; ++i) {
+		if (desc->word_size == 4)
+			store_be32(hash + i * 4, state.w32[i]);
+		else
+			store_be64(hash + i * 8, state.w64[i]);
+	}
+
+	return 0;
+}
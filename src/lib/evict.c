@@ -51,7 +51,7 @@ evictcontrol(TPMI_DH_OBJECT obj_handle, TPMI_DH_PERSISTENT persist_handle)
 re_auth_owner:
 	password_session_create(&s, (char *)owner_auth, owner_auth_size);
 redo:
-	rc = Tss2_Sys_EvictControl(cryptfs_tpm2_sys_context, TPM2_RH_OWNER,
+	rc = Tss2_Sys_EvictControl(tss2_sys_context(), TPM2_RH_OWNER,
 				   obj_handle, &s.sessionsData, persist_handle,
 				   &s.sessionsDataOut);
 	if (rc != TPM2_RC_SUCCESS) {
@@ -73,6 +73,12 @@ redo:
 		return -1;
 	}
 
+	/*
+	 * The evicted handle is gone. The persisted one is cached by the
+	 * caller who knows its public area.
+	 */
+	capability_uncache_public(persist_handle);
+
 	return 0;
 }
 
@@ -83,9 +89,52 @@ cryptfs_tpm2_evict_primary_key(void)
 			    (TPMI_DH_PERSISTENT)CRYPTFS_TPM2_PRIMARY_KEY_HANDLE);
 }
 
+static int
+undefine_nv(TPMI_RH_NV_INDEX nv_index)
+{
+	uint8_t owner_auth[sizeof(TPMU_HA)];
+	unsigned int owner_auth_size = sizeof(owner_auth);
+
+	if (cryptfs_tpm2_option_get_owner_auth(owner_auth, &owner_auth_size))
+		return EXIT_FAILURE;
+
+	struct session_complex s;
+	UINT32 rc;
+
+re_auth_owner:
+	password_session_create(&s, (char *)owner_auth, owner_auth_size);
+redo:
+	rc = Tss2_Sys_NV_UndefineSpace(tss2_sys_context(), TPM2_RH_OWNER,
+				       nv_index, &s.sessionsData,
+				       &s.sessionsDataOut);
+	if (rc != TPM2_RC_SUCCESS) {
+		if (rc == TPM2_RC_LOCKOUT) {
+			if (da_reset() == EXIT_SUCCESS)
+				goto redo;
+		} else if (tpm2_rc_is_format_one(rc) &&
+			   (tpm2_rc_get_code_7bit(rc) | TPM2_RC_FMT1) ==
+			   TPM2_RC_BAD_AUTH) {
+			owner_auth_size = sizeof(owner_auth);
+
+			if (cryptfs_tpm2_util_get_owner_auth(owner_auth,
+							     &owner_auth_size) ==
+							     EXIT_SUCCESS)
+				goto re_auth_owner;
+		}
+
+		err("Unable to undefine the NV index (%#x)\n", rc);
+		return -1;
+	}
+
+	return 0;
+}
+
 int
 cryptfs_tpm2_evict_passphrase(void)
 {
+	if (option_nv == true)
+		return undefine_nv((TPMI_RH_NV_INDEX)CRYPTFS_TPM2_NV_INDEX);
+
 	return evictcontrol((TPMI_DH_OBJECT)CRYPTFS_TPM2_PASSPHRASE_HANDLE,
 			    (TPMI_DH_PERSISTENT)CRYPTFS_TPM2_PASSPHRASE_HANDLE);
 }
@@ -61,7 +61,7 @@ tpm_hash(TPMI_ALG_HASH hash_alg, BYTE *data, UINT16 data_len,
 	TPM2B_DIGEST digest = { { hash_size, } };
 #endif
 
-	UINT32 rc = Tss2_Sys_Hash(cryptfs_tpm2_sys_context, NULL, &data_buf,
+	UINT32 rc = Tss2_Sys_Hash(tss2_sys_context(), NULL, &data_buf,
 				  hash_alg, TPM2_RH_NULL, &digest, NULL,
 				  NULL);
 	if (rc != TPM2_RC_SUCCESS) {
@@ -77,10 +77,24 @@ tpm_hash(TPMI_ALG_HASH hash_alg, BYTE *data, UINT16 data_len,
 	return 0;
 }
 
+static int
+do_digest(TPMI_ALG_HASH hash_alg, BYTE *data, UINT16 data_len, BYTE *hash,
+	  UINT16 hash_size)
+{
+	bool use_tpm;
+
+	if (cryptfs_tpm2_option_get_tpm_hash(&use_tpm) == EXIT_SUCCESS &&
+	    use_tpm == true)
+		return tpm_hash(hash_alg, data, data_len, hash, hash_size);
+
+	return host_digest(hash_alg, data, data_len, hash);
+}
+
 int
 sha1_digest(BYTE *data, UINT16 data_len, BYTE *hash)
 {
-	return tpm_hash(TPM2_ALG_SHA1, data, data_len, hash, TPM2_SHA1_DIGEST_SIZE);
+	return do_digest(TPM2_ALG_SHA1, data, data_len, hash,
+			 TPM2_SHA1_DIGEST_SIZE);
 }
 
 int
@@ -91,5 +105,5 @@ hash_digest(TPMI_ALG_HASH hash_alg, BYTE *data, UINT16 data_len, BYTE *hash)
 	if (util_digest_size(hash_alg, &hash_size))
 		return -1;
 
-	return tpm_hash(hash_alg, data, data_len, hash, hash_size);
+	return do_digest(hash_alg, data, data_len, hash, hash_size);
 }
@@ -36,18 +36,36 @@
 
 #include "internal.h"
 
-void __attribute__ ((constructor))
-libcryptfs_tpm2_init(void)
+/*
+ * The connection to TPM is established on demand, the first time a TPM
+ * command is issued. The long-lived embedders may call this function to
+ * connect to TPM in advance.
+ */
+int
+cryptfs_tpm2_init(void)
 {
-	tss2_init_sys_context();
+	if (!tss2_sys_context())
+		return EXIT_FAILURE;
 
 	dbg("libcryptfs-tpm2 initialized\n");
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Disconnect from TPM. The next TPM command will connect to TPM again.
+ */
+void
+cryptfs_tpm2_teardown(void)
+{
+	tss2_release_sys_context();
 }
 
 void __attribute__((destructor))
 libcryptfs_tpm2_fini(void)
 {
-	tss2_teardown_sys_context();
+	cryptfs_tpm2_teardown();
+	cryptfs_tpm2_tcti_unload();
 
 	dbg("libcryptfs-tpm2 exited\n");
 }
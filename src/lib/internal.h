@@ -77,7 +77,6 @@ struct session_complex {
 	TSS2_SYS_RSP_AUTHS sessionsDataOut;
 };
 #endif
-extern TSS2_SYS_CONTEXT *cryptfs_tpm2_sys_context;
 
 TSS2_RC
 tss2_init_sys_context(void);
@@ -85,6 +84,49 @@ tss2_init_sys_context(void);
 void
 tss2_teardown_sys_context(void);
 
+TSS2_SYS_CONTEXT *
+tss2_sys_context(void);
+
+void
+tss2_release_sys_context(void);
+
+TSS2_TCTI_CONTEXT *
+tss2_tcti_context(void);
+
+void
+trace_attach(TSS2_TCTI_CONTEXT *ctx);
+
+void
+trace_detach(TSS2_TCTI_CONTEXT *ctx);
+
+void
+context_track(TPM2_HANDLE handle);
+
+void
+context_touch(TPM2_HANDLE handle);
+
+int
+context_flush(TPM2_HANDLE handle);
+
+void
+context_flush_all(TSS2_SYS_CONTEXT *sys_context);
+
+bool
+context_reclaim(TSS2_RC rc);
+
+#ifndef TSS2_LEGACY_V1
+int
+sealed_public_marshal(TPMT_PUBLIC *public, BYTE *buf, UINT16 *size);
+
+int
+blob_marshal(TPMI_DH_OBJECT parent, TPM2B_PRIVATE *private,
+	     TPM2B_PUBLIC *public, void **blob, size_t *blob_size);
+
+int
+blob_unmarshal(const void *blob, size_t blob_size, TPMI_DH_OBJECT *parent,
+	       TPM2B_PRIVATE *private, TPM2B_PUBLIC *public);
+#endif
+
 int
 util_digest_size(TPMI_ALG_HASH hash_alg, UINT16 *alg_size);
 
@@ -107,18 +149,53 @@ int
 pcr_policy_extend(TPMI_DH_OBJECT session_handle, TPML_PCR_SELECTION *pcrs,
 		  TPMI_ALG_HASH policy_digest_alg);
 
+int
+pcr_policy_extend_current(TPMI_DH_OBJECT session_handle,
+			  TPML_PCR_SELECTION *pcrs);
+
 int
 password_policy_extend(TPMI_DH_OBJECT session_handle);
 
+int
+policy_digest_init(TPMI_ALG_HASH policy_digest_alg,
+		   TPM2B_DIGEST *policy_digest);
+
+int
+pcr_policy_calc(TPMI_ALG_HASH policy_digest_alg, TPM2B_DIGEST *policy_digest,
+		TPML_PCR_SELECTION *pcrs, TPML_DIGEST *pcr_values);
+
+int
+password_policy_calc(TPMI_ALG_HASH policy_digest_alg,
+		     TPM2B_DIGEST *policy_digest);
+
+int
+pcr_read(TPML_PCR_SELECTION *pcrs, TPML_PCR_SELECTION *pcrs_out,
+	 TPML_DIGEST *pcr_values);
+
 int
 capability_read_public(TPMI_DH_OBJECT handle, TPM2B_PUBLIC *public_out);
 
+void
+capability_cache_public(TPMI_DH_OBJECT handle, TPM2B_PUBLIC *public);
+
+void
+capability_uncache_public(TPMI_DH_OBJECT handle);
+
+int
+capability_read_voted_pcr(TPML_PCR_SELECTION *pcrs,
+			  TPML_PCR_SELECTION *pcrs_out,
+			  TPML_DIGEST *pcr_values);
+
 int
 sha1_digest(BYTE *data, UINT16 data_len, BYTE *hash);
 
 int
 hash_digest(TPMI_ALG_HASH hash_alg, BYTE *data, UINT16 data_len, BYTE *hash);
 
+int
+host_digest(TPMI_ALG_HASH hash_alg, const BYTE *data, UINT32 data_len,
+	    BYTE *hash);
+
 const char *
 get_primary_key_secret(char *out, unsigned int *out_size);
 
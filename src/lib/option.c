@@ -37,6 +37,10 @@
 int option_quite;
 char *option_lockout_auth;
 bool option_no_da = false;
+bool option_check_policy = false;
+bool option_pcr_digest = false;
+bool option_no_create_loaded = false;
+bool option_nv = false;
 
 static uint8_t owner_auth[sizeof(TPMU_HA)];
 static unsigned int owner_auth_size;
@@ -47,6 +51,7 @@ static unsigned int primary_key_secret_size;
 static uint8_t passphrase_secret[sizeof(TPMU_HA)];
 static unsigned int passphrase_secret_size;
 static bool interactive = false;
+static bool tpm_hash = false;
 
 #define option_set_value(name, buf, buf_size, obj, obj_size) \
 do {	\
@@ -166,3 +171,20 @@ cryptfs_tpm2_option_get_interactive(bool *required)
 
 	return EXIT_SUCCESS;
 }
+
+void
+cryptfs_tpm2_option_set_tpm_hash(void)
+{
+	tpm_hash = true;
+}
+
+int
+cryptfs_tpm2_option_get_tpm_hash(bool *required)
+{
+	if (!required)
+		return EXIT_FAILURE;
+
+	*required = tpm_hash;
+
+	return EXIT_SUCCESS;
+}
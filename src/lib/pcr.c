@@ -55,7 +55,7 @@ cryptfs_tpm2_read_pcr(TPMI_ALG_HASH bank_alg, unsigned int index,
 	UINT32 pcr_update_counter;
 	UINT32 rc;
 
-	rc = Tss2_Sys_PCR_Read(cryptfs_tpm2_sys_context, NULL, &pcrs,
+	rc = Tss2_Sys_PCR_Read(tss2_sys_context(), NULL, &pcrs,
 			       &pcr_update_counter, &pcrs_out, &pcr_digest,
 			       NULL);
 	if (rc != TPM2_RC_SUCCESS) {
@@ -95,3 +95,56 @@ cryptfs_tpm2_read_pcr(TPMI_ALG_HASH bank_alg, unsigned int index,
 #endif
 	return 0;
 }
+
+int
+pcr_read(TPML_PCR_SELECTION *pcrs, TPML_PCR_SELECTION *pcrs_out,
+	 TPML_DIGEST *pcr_values)
+{
+	UINT32 pcr_update_counter;
+	UINT32 rc;
+
+	rc = Tss2_Sys_PCR_Read(tss2_sys_context(), NULL, pcrs,
+			       &pcr_update_counter, pcrs_out, pcr_values,
+			       NULL);
+	if (rc != TPM2_RC_SUCCESS) {
+		err("Unable to read the PCRs (%#x)\n", rc);
+		return -1;
+	}
+
+	unsigned int nr_pcr = 0;
+
+	for (UINT32 c = 0; c < pcrs->count; ++c) {
+		TPMS_PCR_SELECTION *pcr_sel = pcrs->pcrSelections + c;
+		TPMS_PCR_SELECTION *pcr_sel_real = pcrs_out->pcrSelections + c;
+
+		if (c >= pcrs_out->count || pcr_sel_real->hash != pcr_sel->hash) {
+			err("PCR bank %#x is not supported\n", pcr_sel->hash);
+			return -1;
+		}
+
+		for (UINT8 s = 0; s < pcr_sel->sizeofSelect; ++s) {
+			BYTE sel = pcr_sel->pcrSelect[s];
+			BYTE sel_real = 0;
+
+			if (s < pcr_sel_real->sizeofSelect)
+				sel_real = pcr_sel_real->pcrSelect[s];
+
+			/* Check whether the input pcrs contain unsupported PCRs */
+			if ((sel & sel_real) != sel) {
+				err("PCR %x is not supported\n",
+				    s * 8 + __builtin_ctz(sel & ~sel_real));
+				return -1;
+			}
+
+			nr_pcr += __builtin_popcount(sel);
+		}
+	}
+
+	if (pcr_values->count != nr_pcr) {
+		err("The PCRs read (%d) are less than the specified (%d)\n",
+		    pcr_values->count, nr_pcr);
+		return -1;
+	}
+
+	return 0;
+}
@@ -77,7 +77,7 @@ extend_pcr_policy_digest(TPMI_DH_OBJECT session_handle,
 
 	pcr_digests->count = nr_pcr;
 
-	UINT32 rc = Tss2_Sys_PCR_Read(cryptfs_tpm2_sys_context, NULL, pcrs,
+	UINT32 rc = Tss2_Sys_PCR_Read(tss2_sys_context(), NULL, pcrs,
 				      &pcr_update_counter, &pcrs_out,
 				      pcr_digests, NULL);
 	if (rc != TPM2_RC_SUCCESS) {
@@ -162,7 +162,7 @@ extend_pcr_policy_digest(TPMI_DH_OBJECT session_handle,
 		return -1;
 	}
 
-	rc = Tss2_Sys_PolicyPCR(cryptfs_tpm2_sys_context, session_handle,
+	rc = Tss2_Sys_PolicyPCR(tss2_sys_context(), session_handle,
                                 NULL, &digest_tpm, &pcrs_out, NULL);
 	if (rc != TPM2_RC_SUCCESS) {
 		err("Unable to set the policy for PCRs (%#x)\n", rc);
@@ -180,10 +180,34 @@ pcr_policy_extend(TPMI_DH_OBJECT session_handle, TPML_PCR_SELECTION *pcrs,
 					policy_digest_alg);
 }
 
+/*
+ * Leave pcrDigest empty so that TPM evaluates PolicyPCR with the current
+ * PCR values. This saves PCR_Read and the hash chain at unseal time.
+ */
+int
+pcr_policy_extend_current(TPMI_DH_OBJECT session_handle,
+			  TPML_PCR_SELECTION *pcrs)
+{
+#ifndef TSS2_LEGACY_V1
+	TPM2B_DIGEST empty_digest = { 0, };
+#else
+	TPM2B_DIGEST empty_digest = { { 0, } };
+#endif
+
+	UINT32 rc = Tss2_Sys_PolicyPCR(tss2_sys_context(), session_handle,
+				       NULL, &empty_digest, pcrs, NULL);
+	if (rc != TPM2_RC_SUCCESS) {
+		err("Unable to set the policy for PCRs (%#x)\n", rc);
+		return -1;
+	}
+
+	return 0;
+}
+
 int
 password_policy_extend(TPMI_DH_OBJECT session_handle)
 {
-	UINT32 rc = Tss2_Sys_PolicyPassword(cryptfs_tpm2_sys_context,
+	UINT32 rc = Tss2_Sys_PolicyPassword(tss2_sys_context(),
 					    session_handle, NULL, NULL);
 	if (rc != TPM2_RC_SUCCESS) {
 		err("Unable to set the policy for password (%#x)\n", rc);
@@ -192,3 +216,131 @@ password_policy_extend(TPMI_DH_OBJECT session_handle)
 
 	return 0;
 }
+
+static int
+policy_digest_extend(TPMI_ALG_HASH policy_digest_alg,
+		     TPM2B_DIGEST *policy_digest, BYTE *data,
+		     unsigned int data_size)
+{
+	UINT16 alg_size;
+
+	if (util_digest_size(policy_digest_alg, &alg_size))
+		return -1;
+
+	BYTE buf[alg_size + data_size];
+
+#ifndef TSS2_LEGACY_V1
+	memcpy(buf, policy_digest->buffer, alg_size);
+	memcpy(buf + alg_size, data, data_size);
+
+	return host_digest(policy_digest_alg, buf, alg_size + data_size,
+			   policy_digest->buffer);
+#else
+	memcpy(buf, policy_digest->t.buffer, alg_size);
+	memcpy(buf + alg_size, data, data_size);
+
+	return host_digest(policy_digest_alg, buf, alg_size + data_size,
+			   policy_digest->t.buffer);
+#endif
+}
+
+static unsigned int
+marshal_uint32(BYTE *buf, UINT32 val)
+{
+	buf[0] = val >> 24;
+	buf[1] = val >> 16;
+	buf[2] = val >> 8;
+	buf[3] = val;
+
+	return sizeof(val);
+}
+
+int
+policy_digest_init(TPMI_ALG_HASH policy_digest_alg,
+		   TPM2B_DIGEST *policy_digest)
+{
+	UINT16 alg_size;
+
+	if (util_digest_size(policy_digest_alg, &alg_size))
+		return -1;
+
+#ifndef TSS2_LEGACY_V1
+	policy_digest->size = alg_size;
+	memset(policy_digest->buffer, 0, alg_size);
+#else
+	policy_digest->t.size = alg_size;
+	memset(policy_digest->t.buffer, 0, alg_size);
+#endif
+	return 0;
+}
+
+/*
+ * Replay TPM2_PolicyPCR on the host:
+ * policyDigest' = H(policyDigest || TPM_CC_PolicyPCR || pcrs || pcrDigest)
+ * where pcrDigest = H(PCR values in the order of pcrs).
+ */
+int
+pcr_policy_calc(TPMI_ALG_HASH policy_digest_alg, TPM2B_DIGEST *policy_digest,
+		TPML_PCR_SELECTION *pcrs, TPML_DIGEST *pcr_values)
+{
+	UINT16 alg_size;
+
+	if (util_digest_size(policy_digest_alg, &alg_size))
+		return -1;
+
+	BYTE values[sizeof(pcr_values->digests)];
+	unsigned int values_size = 0;
+
+	for (UINT32 i = 0; i < pcr_values->count; ++i) {
+#ifndef TSS2_LEGACY_V1
+		memcpy(values + values_size, pcr_values->digests[i].buffer,
+		       pcr_values->digests[i].size);
+		values_size += pcr_values->digests[i].size;
+#else
+		memcpy(values + values_size, pcr_values->digests[i].t.buffer,
+		       pcr_values->digests[i].t.size);
+		values_size += pcr_values->digests[i].t.size;
+#endif
+	}
+
+	BYTE buf[sizeof(UINT32) + sizeof(TPML_PCR_SELECTION) +
+		 sizeof(TPMU_HA)];
+	unsigned int size = 0;
+
+	size += marshal_uint32(buf + size, TPM2_CC_PolicyPCR);
+	size += marshal_uint32(buf + size, pcrs->count);
+
+	for (UINT32 c = 0; c < pcrs->count; ++c) {
+		TPMS_PCR_SELECTION *pcr_sel = pcrs->pcrSelections + c;
+
+		buf[size++] = pcr_sel->hash >> 8;
+		buf[size++] = pcr_sel->hash;
+		buf[size++] = pcr_sel->sizeofSelect;
+		memcpy(buf + size, pcr_sel->pcrSelect, pcr_sel->sizeofSelect);
+		size += pcr_sel->sizeofSelect;
+	}
+
+	if (host_digest(policy_digest_alg, values, values_size, buf + size))
+		return -1;
+	size += alg_size;
+
+	return policy_digest_extend(policy_digest_alg, policy_digest, buf,
+				    size);
+}
+
+/*
+ * Replay TPM2_PolicyPassword on the host. It is identical to
+ * TPM2_PolicyAuthValue in terms of the policy digest:
+ * policyDigest' = H(policyDigest || TPM_CC_PolicyAuthValue)
+ */
+int
+password_policy_calc(TPMI_ALG_HASH policy_digest_alg,
+		     TPM2B_DIGEST *policy_digest)
+{
+	BYTE buf[sizeof(UINT32)];
+
+	marshal_uint32(buf, TPM2_CC_PolicyAuthValue);
+
+	return policy_digest_extend(policy_digest_alg, policy_digest, buf,
+				    sizeof(buf));
+}
@@ -46,7 +46,7 @@ cryptefs_tpm2_get_random(uint8_t *random, size_t *req_size)
 #endif
 	TPM2_RC rc;
 
-	rc = Tss2_Sys_GetRandom(cryptfs_tpm2_sys_context, NULL, *req_size,
+	rc = Tss2_Sys_GetRandom(tss2_sys_context(), NULL, *req_size,
 				&random_bytes, NULL);
 	if (rc != TSS2_RC_SUCCESS) {
 		err("Unable to get the random number (%#x)\n", rc);
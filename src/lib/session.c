@@ -101,6 +101,7 @@ policy_auth_set(TPMS_AUTH_COMMAND *session, TPMI_SH_AUTH_SESSION handle,
 	set_session_auth(session, handle, auth_password,
 			 auth_password && auth_password_size ?
 			 auth_password_size : 0);
+	context_touch(handle);
 }
 
 /*
@@ -146,19 +147,24 @@ policy_session_create(struct session_complex *s, TPM2_SE type,
 #else
 	nonce_tpm.t.size = nonce_caller.t.size;
 #endif
-	UINT32 rc = Tss2_Sys_StartAuthSession(cryptfs_tpm2_sys_context,
-					      TPM2_RH_NULL, TPM2_RH_NULL, NULL,
-					      &nonce_caller, &salt,
-					      type, &symmetric,
-					      hash_alg, &s->session_handle,
-					      &nonce_tpm, NULL);
+	UINT32 rc;
+
+redo:
+	rc = Tss2_Sys_StartAuthSession(tss2_sys_context(), TPM2_RH_NULL,
+				       TPM2_RH_NULL, NULL, &nonce_caller,
+				       &salt, type, &symmetric, hash_alg,
+				       &s->session_handle, &nonce_tpm, NULL);
 	if (rc != TPM2_RC_SUCCESS) {
+		if (context_reclaim(rc) == true)
+			goto redo;
+
 		err("Unable to create a %spolicy session "
 		    "(%#x)\n", type == TPM2_SE_TRIAL ? "trial " : "",
 		    rc);
 		return -1;
 	}
 
+	context_track(s->session_handle);
 	complete_session_complex(s);
 
 	dbg("The %spolicy session handle %#8.8x created\n",
@@ -174,13 +180,8 @@ policy_session_destroy(struct session_complex *s)
 	if (s->session_handle == TPM2_RS_PW)
 		return;
 
-	UINT32 rc = Tss2_Sys_FlushContext(cryptfs_tpm2_sys_context,
-					  s->session_handle);
-	if (rc == TPM2_RC_SUCCESS)
+	if (!context_flush(s->session_handle))
 		dbg("The policy session %#8.8x destroyed\n", s->session_handle);
-	else
-		err("Unable to destroy the policy session handle "
-		    "(%#x)\n", rc);
 }
 
 void
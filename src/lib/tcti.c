@@ -44,17 +44,21 @@ init_tcti_tabrmd(void)
 	TSS2_RC rc;
 #ifndef TSS2_LEGACY_V1
 	TSS2_RC (*init)(TSS2_TCTI_CONTEXT *, size_t *, const char *);
-
-	tcti_handle = dlopen("libtss2-tcti-tabrmd.so.0", RTLD_LAZY);
 #else
 	TSS2_RC (*init)(TSS2_TCTI_CONTEXT *, size_t *);
-
-	tcti_handle = dlopen("libtcti-tabrmd.so.0", RTLD_LAZY);
 #endif
 
+	/* Keep the library loaded across the retries of tcti-probe */
 	if (!tcti_handle) {
-		err("Unable to find out the tabrmd tcti library\n");
-		return NULL;
+#ifndef TSS2_LEGACY_V1
+		tcti_handle = dlopen("libtss2-tcti-tabrmd.so.0", RTLD_LAZY);
+#else
+		tcti_handle = dlopen("libtcti-tabrmd.so.0", RTLD_LAZY);
+#endif
+		if (!tcti_handle) {
+			err("Unable to find out the tabrmd tcti library\n");
+			return NULL;
+		}
 	}
 
 #ifndef TSS2_LEGACY_V1
@@ -64,6 +68,7 @@ init_tcti_tabrmd(void)
 #endif
 	if (!init) {
 		dlclose(tcti_handle);
+		tcti_handle = NULL;
 		return NULL;
 	}
 
@@ -73,7 +78,6 @@ init_tcti_tabrmd(void)
 	rc = init(NULL, &size);
 #endif
 	if (rc != TSS2_RC_SUCCESS) {
-		dlclose(tcti_handle);
 		err("Unable to get the size of tabrmd tcti context\n");
 		return NULL;
 	}
@@ -91,7 +95,6 @@ init_tcti_tabrmd(void)
 			err("Unable to initialize tabrmd tcti context\n");
 			free(ctx);
 			ctx = NULL;
-			dlclose(tcti_handle);
 		}
 	}
 
@@ -239,7 +242,18 @@ cryptfs_tpm2_tcti_teardown_context(TSS2_TCTI_CONTEXT *ctx)
 	tss2_tcti_finalize(ctx);
 #endif
 	free(ctx);
+}
 
-	if (tcti_handle)
+/*
+ * The tabrmd tcti library stays loaded when the context is torn down, so
+ * that the retries of tcti-probe don't reload it. It is only unloaded
+ * along with libcryptfs-tpm2.
+ */
+void
+cryptfs_tpm2_tcti_unload(void)
+{
+	if (tcti_handle) {
 		dlclose(tcti_handle);
+		tcti_handle = NULL;
+	}
 }
@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2024, Alibaba Cloud
+ * Copyright (c) 2016-2023, Wind River Systems, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1) Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2) Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3) Neither the name of Wind River Systems nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author:
+ *        Jia Zhang <zhang.jia@linux.alibaba.com>
+ */
+
+#include <cryptfs_tpm2.h>
+
+#include "internal.h"
+
+/*
+ * Trace every TPM command by hooking the transmit and receive entries of
+ * the TCTI context. All Tss2_Sys_* calls end up there, so the trace
+ * covers them without touching each call site.
+ */
+
+struct trace_event {
+	UINT32 command_code;
+	UINT32 response_code;
+	size_t command_size;
+	size_t response_size;
+	double start;
+	double end;
+};
+
+#ifndef TSS2_LEGACY_V1
+typedef TSS2_TCTI_TRANSMIT_FCN trace_transmit_fcn;
+typedef TSS2_TCTI_RECEIVE_FCN trace_receive_fcn;
+#else
+typedef TSS2_RC (*trace_transmit_fcn)(TSS2_TCTI_CONTEXT *tctiContext,
+				      size_t size, uint8_t *command);
+typedef TSS2_RC (*trace_receive_fcn)(TSS2_TCTI_CONTEXT *tctiContext,
+				     size_t *size, uint8_t *response,
+				     int32_t timeout);
+#endif
+
+static char *trace_file;
+static struct trace_event *trace_events;
+static unsigned int nr_trace_event;
+static unsigned int max_trace_event;
+static struct trace_event trace_pending;
+static double trace_base;
+static TSS2_TCTI_CONTEXT *trace_tcti_context;
+static trace_transmit_fcn trace_transmit_orig;
+static trace_receive_fcn trace_receive_orig;
+
+#ifndef TSS2_LEGACY_V1
+#define TRACE_CC(name)		{ TPM2_CC_##name, #name }
+#else
+#define TRACE_CC(name)		{ TPM_CC_##name, #name }
+#endif
+
+static const struct {
+	UINT32 command_code;
+	const char *name;
+} command_names[] = {
+	TRACE_CC(EvictControl),
+	TRACE_CC(DictionaryAttackLockReset),
+	TRACE_CC(NV_DefineSpace),
+	TRACE_CC(NV_UndefineSpace),
+	TRACE_CC(CreatePrimary),
+	TRACE_CC(NV_Write),
+	TRACE_CC(NV_WriteLock),
+	TRACE_CC(NV_Read),
+	TRACE_CC(Create),
+	TRACE_CC(Load),
+	TRACE_CC(Unseal),
+	TRACE_CC(ContextLoad),
+	TRACE_CC(ContextSave),
+	TRACE_CC(FlushContext),
+	TRACE_CC(NV_ReadPublic),
+	TRACE_CC(PolicyAuthValue),
+	TRACE_CC(ReadPublic),
+	TRACE_CC(StartAuthSession),
+	TRACE_CC(GetCapability),
+	TRACE_CC(GetRandom),
+	TRACE_CC(Hash),
+	TRACE_CC(PCR_Read),
+	TRACE_CC(PolicyPCR),
+	TRACE_CC(PolicyGetDigest),
+	TRACE_CC(PolicyPassword),
+#ifndef TSS2_LEGACY_V1
+	TRACE_CC(CreateLoaded),
+#endif
+};
+
+#undef TRACE_CC
+
+static const char *
+command_name(UINT32 command_code)
+{
+	for (unsigned int i = 0; i < sizeof(command_names) /
+				     sizeof(command_names[0]); ++i) {
+		if (command_names[i].command_code == command_code)
+			return command_names[i].name;
+	}
+
+	return "Unknown";
+}
+
+static double
+trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static UINT32
+unmarshal_uint32(const uint8_t *buf)
+{
+	return ((UINT32)buf[0] << 24) | ((UINT32)buf[1] << 16) |
+	       ((UINT32)buf[2] << 8) | buf[3];
+}
+
+static void
+trace_record(struct trace_event *event)
+{
+	if (nr_trace_event == max_trace_event) {
+		unsigned int nr = max_trace_event ? max_trace_event * 2 : 64;
+		struct trace_event *events;
+
+		events = realloc(trace_events, nr * sizeof(*events));
+		if (!events)
+			return;
+
+		trace_events = events;
+		max_trace_event = nr;
+	}
+
+	trace_events[nr_trace_event++] = *event;
+}
+
+/* The command header is tag (2), commandSize (4) and commandCode (4) */
+static TSS2_RC
+#ifndef TSS2_LEGACY_V1
+trace_transmit(TSS2_TCTI_CONTEXT *ctx, size_t size, const uint8_t *command)
+#else
+trace_transmit(TSS2_TCTI_CONTEXT *ctx, size_t size, uint8_t *command)
+#endif
+{
+	if (trace_file) {
+		memset(&trace_pending, 0, sizeof(trace_pending));
+
+		if (size >= 10)
+			trace_pending.command_code = unmarshal_uint32(command + 6);
+		trace_pending.command_size = size;
+		trace_pending.start = trace_now();
+	}
+
+	return trace_transmit_orig(ctx, size, command);
+}
+
+/* The response header is tag (2), responseSize (4) and responseCode (4) */
+static TSS2_RC
+trace_receive(TSS2_TCTI_CONTEXT *ctx, size_t *size, uint8_t *response,
+	      int32_t timeout)
+{
+	TSS2_RC rc = trace_receive_orig(ctx, size, response, timeout);
+
+	/* Querying the size of response doesn't complete a command */
+	if (!trace_file || !response || !trace_pending.start)
+		return rc;
+
+	if (rc != TSS2_RC_SUCCESS) {
+#ifndef TSS2_LEGACY_V1
+		if (rc == TSS2_TCTI_RC_TRY_AGAIN)
+			return rc;
+#endif
+		trace_pending.response_code = rc;
+	} else {
+		trace_pending.response_size = *size;
+		if (*size >= 10)
+			trace_pending.response_code = unmarshal_uint32(response + 6);
+	}
+
+	trace_pending.end = trace_now();
+	trace_record(&trace_pending);
+	trace_pending.start = 0;
+
+	return rc;
+}
+
+void
+trace_attach(TSS2_TCTI_CONTEXT *ctx)
+{
+	if (!trace_file || !ctx || trace_tcti_context == ctx)
+		return;
+
+	trace_transmit_orig = TSS2_TCTI_TRANSMIT(ctx);
+	trace_receive_orig = TSS2_TCTI_RECEIVE(ctx);
+	TSS2_TCTI_TRANSMIT(ctx) = trace_transmit;
+	TSS2_TCTI_RECEIVE(ctx) = trace_receive;
+	trace_tcti_context = ctx;
+}
+
+void
+trace_detach(TSS2_TCTI_CONTEXT *ctx)
+{
+	if (!ctx || trace_tcti_context != ctx)
+		return;
+
+	TSS2_TCTI_TRANSMIT(ctx) = trace_transmit_orig;
+	TSS2_TCTI_RECEIVE(ctx) = trace_receive_orig;
+	trace_tcti_context = NULL;
+}
+
+int
+cryptfs_tpm2_trace_start(const char *file)
+{
+	if (trace_file) {
+		err("The trace has been already started\n");
+		return EXIT_FAILURE;
+	}
+
+	trace_file = strdup(file);
+	if (!trace_file) {
+		err("Unable to allocate the trace file path\n");
+		return EXIT_FAILURE;
+	}
+
+	trace_base = trace_now();
+
+	trace_attach(tss2_tcti_context());
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Write the recorded TPM commands in the Chrome trace event format,
+ * which can be loaded by chrome://tracing or Perfetto.
+ */
+int
+cryptfs_tpm2_trace_stop(void)
+{
+	if (!trace_file)
+		return EXIT_SUCCESS;
+
+	int rc = EXIT_SUCCESS;
+	FILE *fp = fopen(trace_file, "w");
+
+	if (!fp) {
+		err("Unable to open the trace file %s (%s)\n", trace_file,
+		    strerror(errno));
+		rc = EXIT_FAILURE;
+		goto out;
+	}
+
+	pid_t pid = getpid();
+	pid_t tid = syscall(SYS_gettid);
+
+	fprintf(fp, "{\"traceEvents\":[\n");
+
+	for (unsigned int i = 0; i < nr_trace_event; ++i) {
+		struct trace_event *event = trace_events + i;
+
+		fprintf(fp, "{\"name\":\"%s\",\"cat\":\"tpm2\",\"ph\":\"X\","
+			"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+			"\"args\":{\"command_code\":\"0x%x\","
+			"\"response_code\":\"0x%x\",\"command_size\":%zu,"
+			"\"response_size\":%zu}}%s\n",
+			command_name(event->command_code),
+			event->start - trace_base, event->end - event->start,
+			pid, tid, event->command_code, event->response_code,
+			event->command_size, event->response_size,
+			i + 1 < nr_trace_event ? "," : "");
+	}
+
+	fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+
+	if (fclose(fp)) {
+		err("Unable to write the trace file %s (%s)\n", trace_file,
+		    strerror(errno));
+		rc = EXIT_FAILURE;
+	} else
+		info("Wrote %d TPM commands to the trace file %s\n",
+		     nr_trace_event, trace_file);
+
+out:
+	trace_detach(trace_tcti_context);
+
+	free(trace_events);
+	trace_events = NULL;
+	nr_trace_event = max_trace_event = 0;
+
+	free(trace_file);
+	trace_file = NULL;
+
+	return rc;
+}
@@ -41,9 +41,9 @@
 #define TSS_SAPI_FIRST_LEVEL 1
 #define TSS_SAPI_FIRST_VERSION 108
 
-TSS2_SYS_CONTEXT *cryptfs_tpm2_sys_context;
-
+static TSS2_SYS_CONTEXT *cryptfs_tpm2_sys_context;
 static TSS2_TCTI_CONTEXT *tcti_context;
+static pthread_mutex_t sys_context_lock = PTHREAD_MUTEX_INITIALIZER;
 
 TSS2_RC
 tss2_init_sys_context(void)
@@ -58,6 +58,9 @@ tss2_init_sys_context(void)
 	UINT32 size;
 	TSS2_RC rc;
 
+	if (cryptfs_tpm2_sys_context)
+		return TSS2_RC_SUCCESS;
+
 	tcti_context = cryptfs_tpm2_tcti_init_context();
 	if (!tcti_context)
 		return TSS2_TCTI_RC_BAD_CONTEXT;
@@ -84,16 +87,57 @@ tss2_init_sys_context(void)
 
 	cryptfs_tpm2_sys_context = sys_context;
 
+	trace_attach(tcti_context);
+
 	return TSS2_RC_SUCCESS;
 }
 
+/*
+ * Connect to TPM on demand, the first time a TPM command is issued.
+ */
+TSS2_SYS_CONTEXT *
+tss2_sys_context(void)
+{
+	TSS2_SYS_CONTEXT *sys_context;
+
+	pthread_mutex_lock(&sys_context_lock);
+
+	if (!cryptfs_tpm2_sys_context)
+		tss2_init_sys_context();
+	sys_context = cryptfs_tpm2_sys_context;
+
+	pthread_mutex_unlock(&sys_context_lock);
+
+	return sys_context;
+}
+
+void
+tss2_release_sys_context(void)
+{
+	pthread_mutex_lock(&sys_context_lock);
+	tss2_teardown_sys_context();
+	pthread_mutex_unlock(&sys_context_lock);
+}
+
+TSS2_TCTI_CONTEXT *
+tss2_tcti_context(void)
+{
+	return tcti_context;
+}
+
 void
 tss2_teardown_sys_context(void)
 {
+	if (!cryptfs_tpm2_sys_context)
+		return;
+
+	context_flush_all(cryptfs_tpm2_sys_context);
+
 	Tss2_Sys_Finalize(cryptfs_tpm2_sys_context);
 	free(cryptfs_tpm2_sys_context);
 	cryptfs_tpm2_sys_context = NULL;
 
+	trace_detach(tcti_context);
 	cryptfs_tpm2_tcti_teardown_context(tcti_context);
 	tcti_context = NULL;
 }
@@ -36,9 +36,60 @@
 
 #include "internal.h"
 
-int
-cryptfs_tpm2_unseal_passphrase(TPMI_ALG_HASH pcr_bank_alg, void **passphrase,
-			       size_t *passphrase_size)
+/*
+ * Read the passphrase from the NV index in one TPM2_NV_Read, and strip
+ * the size prefix.
+ */
+static UINT32
+read_nv_passphrase(struct session_complex *s, TPM2B_SENSITIVE_DATA *out_data)
+{
+#ifndef TSS2_LEGACY_V1
+	TPM2B_MAX_NV_BUFFER nv_data = { sizeof(TPM2B_MAX_NV_BUFFER)-2, };
+#else
+	TPM2B_MAX_NV_BUFFER nv_data = { { sizeof(TPM2B_MAX_NV_BUFFER)-2, } };
+#endif
+	UINT32 rc;
+
+	rc = Tss2_Sys_NV_Read(tss2_sys_context(), CRYPTFS_TPM2_NV_INDEX,
+			      CRYPTFS_TPM2_NV_INDEX, &s->sessionsData,
+			      CRYPTFS_TPM2_NV_SIZE, 0, &nv_data,
+			      &s->sessionsDataOut);
+	if (rc != TPM2_RC_SUCCESS)
+		return rc;
+
+#ifndef TSS2_LEGACY_V1
+	UINT16 size = (nv_data.buffer[0] << 8) | nv_data.buffer[1];
+
+	if (!size || size > nv_data.size - 2 ||
+	    size > sizeof(out_data->buffer)) {
+		err("Invalid passphrase size %d in the NV index\n", size);
+		memset(&nv_data, 0, sizeof(nv_data));
+		return TPM2_RC_SIZE;
+	}
+
+	out_data->size = size;
+	memcpy(out_data->buffer, nv_data.buffer + 2, size);
+#else
+	UINT16 size = (nv_data.t.buffer[0] << 8) | nv_data.t.buffer[1];
+
+	if (!size || size > nv_data.t.size - 2 ||
+	    size > sizeof(out_data->t.buffer)) {
+		err("Invalid passphrase size %d in the NV index\n", size);
+		memset(&nv_data, 0, sizeof(nv_data));
+		return TPM2_RC_SIZE;
+	}
+
+	out_data->t.size = size;
+	memcpy(out_data->t.buffer, nv_data.t.buffer + 2, size);
+#endif
+	memset(&nv_data, 0, sizeof(nv_data));
+
+	return TPM2_RC_SUCCESS;
+}
+
+static int
+unseal_passphrase(TPMI_DH_OBJECT handle, TPMI_ALG_HASH pcr_bank_alg,
+		  void **passphrase, size_t *passphrase_size)
 {
 	struct session_complex s;
 	char secret[256];
@@ -64,8 +115,18 @@ redo:
 		pcrs.pcrSelections->pcrSelect[pcr_index / 8] |=
 			(1 << (pcr_index % 8));
 
-		if (pcr_policy_extend(s.session_handle, &pcrs,
-				      policy_digest_alg)) {
+		int ret;
+
+		if (option_pcr_digest == true) {
+			dbg("Applying PolicyPCR with the PCR digest\n");
+			ret = pcr_policy_extend(s.session_handle, &pcrs,
+						policy_digest_alg);
+		} else {
+			dbg("Applying PolicyPCR with the current PCRs\n");
+			ret = pcr_policy_extend_current(s.session_handle,
+							&pcrs);
+		}
+		if (ret) {
 			policy_session_destroy(&s);
 			return -1;
 		}
@@ -93,10 +154,12 @@ redo:
 #endif
 	UINT32 rc;
 
-	rc = Tss2_Sys_Unseal(cryptfs_tpm2_sys_context,
-			     CRYPTFS_TPM2_PASSPHRASE_HANDLE,
-			     &s.sessionsData, &out_data,
-			     &s.sessionsDataOut);
+	if (option_nv == true)
+		rc = read_nv_passphrase(&s, &out_data);
+	else
+		rc = Tss2_Sys_Unseal(tss2_sys_context(), handle,
+				     &s.sessionsData, &out_data,
+				     &s.sessionsDataOut);
 	policy_session_destroy(&s);
 	if (rc != TPM2_RC_SUCCESS) {
 		if (rc == TPM2_RC_LOCKOUT) {
@@ -117,10 +180,15 @@ redo:
 				goto redo;
 		}
 
-		err("Unable to unseal the passphrase object (%#x)\n", rc);
+		err("Unable to unseal the passphrase %s (%#x)\n",
+		    option_nv == true ? "NV index" : "object", rc);
 		return -1;
 	}
 
+	if (pcr_bank_alg != TPM2_ALG_NULL)
+		info("PolicyPCR satisfied in %s mode\n",
+		     option_pcr_digest == true ? "PCR digest" : "current PCRs");
+
 #ifndef TSS2_LEGACY_V1
 	info("Succeed to unseal the passphrase (%d-byte)\n", out_data.size);
 
@@ -140,5 +208,110 @@ redo:
 	memcpy(*passphrase, out_data.t.buffer, out_data.t.size);
 	*passphrase_size = out_data.t.size;
 #endif
+	/* Don't leave a copy of the secret on the stack */
+	memset(&out_data, 0, sizeof(out_data));
+
+	return 0;
+}
+
+int
+cryptfs_tpm2_unseal_passphrase(TPMI_ALG_HASH pcr_bank_alg, void **passphrase,
+			       size_t *passphrase_size)
+{
+	return unseal_passphrase(CRYPTFS_TPM2_PASSPHRASE_HANDLE, pcr_bank_alg,
+				 passphrase, passphrase_size);
+}
+
+#ifndef TSS2_LEGACY_V1
+static int
+load_blob(TPMI_DH_OBJECT parent, TPM2B_PRIVATE *private,
+	  TPM2B_PUBLIC *public, TPMI_DH_OBJECT *handle)
+{
+	char secret[CRYPTFS_TPM2_SECRET_MAX_SIZE];
+	unsigned int secret_size;
+	TPM2B_NAME name = { sizeof(TPM2B_NAME) - 2, };
+	struct session_complex s;
+	UINT32 rc;
+
+re_auth_pkey:
+	secret_size = sizeof(secret);
+	/* The SRK is created with the empty authorization by TCG template */
+	if (parent == CRYPTFS_TPM2_SRK_HANDLE)
+		secret_size = 0;
+	else
+		get_primary_key_secret(secret, &secret_size);
+redo:
+	password_session_create(&s, (char *)secret, secret_size);
+
+	rc = Tss2_Sys_Load(tss2_sys_context(), parent, &s.sessionsData,
+			   private, public, handle, &name,
+			   &s.sessionsDataOut);
+	if (rc != TPM2_RC_SUCCESS) {
+		if (context_reclaim(rc) == true)
+			goto redo;
+
+		if (rc == TPM2_RC_LOCKOUT) {
+			if (da_reset() == EXIT_SUCCESS)
+				goto re_auth_pkey;
+		} else if (parent == CRYPTFS_TPM2_PRIMARY_KEY_HANDLE &&
+			   tpm2_rc_is_format_one(rc) &&
+			   (((tpm2_rc_get_code_7bit(rc) | TPM2_RC_FMT1) ==
+			   TPM2_RC_BAD_AUTH) ||
+			   ((tpm2_rc_get_code_7bit(rc) | TPM2_RC_FMT1) ==
+			   TPM2_RC_AUTH_FAIL))) {
+			err("Wrong primary key secret specified\n");
+
+			secret_size = sizeof(secret);
+
+			if (cryptfs_tpm2_util_get_primary_key_secret((uint8_t *)secret,
+								     &secret_size) ==
+			    EXIT_SUCCESS)
+				goto redo;
+		}
+
+		err("Unable to load the passphrase object (%#x)\n", rc);
+		return -1;
+	}
+
+	context_track(*handle);
+
 	return 0;
 }
+#endif
+
+/*
+ * Load the passphrase object from the blob exported by
+ * cryptfs_tpm2_create_passphrase_blob(), unseal it and flush it.
+ */
+int
+cryptfs_tpm2_unseal_passphrase_blob(TPMI_ALG_HASH pcr_bank_alg,
+				    const void *blob, size_t blob_size,
+				    void **passphrase, size_t *passphrase_size)
+{
+#ifndef TSS2_LEGACY_V1
+	TPMI_DH_OBJECT parent, handle;
+	TPM2B_PRIVATE private;
+	TPM2B_PUBLIC public;
+
+	if (option_nv == true) {
+		err("The passphrase in the NV index is not a blob\n");
+		return -1;
+	}
+
+	if (blob_unmarshal(blob, blob_size, &parent, &private, &public))
+		return -1;
+
+	if (load_blob(parent, &private, &public, &handle))
+		return -1;
+
+	int rc = unseal_passphrase(handle, pcr_bank_alg, passphrase,
+				   passphrase_size);
+
+	context_flush(handle);
+
+	return rc;
+#else
+	err("Unsealing the passphrase blob is not supported\n");
+	return -1;
+#endif
+}
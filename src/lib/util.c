@@ -39,6 +39,8 @@
 #endif
 
 static int show_verbose;
+static cryptfs_tpm2_log_handler_t log_handler;
+static void *log_data;
 
 int
 util_digest_size(TPMI_ALG_HASH hash_alg, UINT16 *alg_size)
@@ -79,6 +81,38 @@ cryptfs_tpm2_util_set_verbosity(int verbose)
 	show_verbose = verbose;
 }
 
+/*
+ * Redirect the messages to the handler, e.g, for a host process which
+ * the library is loaded into. NULL handler restores the default output
+ * to stdout/stderr.
+ */
+void
+cryptfs_tpm2_util_set_log_handler(cryptfs_tpm2_log_handler_t handler,
+				  void *data)
+{
+	log_handler = handler;
+	log_data = data;
+}
+
+/* Return false if no handler is set and the caller needs to print */
+bool
+cryptfs_tpm2_util_log(int level, const char *fmt, ...)
+{
+	if (!log_handler)
+		return false;
+
+	char msg[1024];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+
+	log_handler(level, msg, log_data);
+
+	return true;
+}
+
 char **
 cryptfs_tpm2_util_split_string(char *in, char *delim, unsigned int *nr)
 {
@@ -243,6 +277,213 @@ cryptfs_tpm2_util_save_output_file(const char *file_path, uint8_t *buf,
 	return 0;
 }
 
+/*
+ * The hex string is used to carry the binary data in a text container,
+ * e.g, the LUKS2 token JSON.
+ */
+int
+cryptfs_tpm2_util_hex_encode(const uint8_t *in, unsigned long in_len,
+			     char **out)
+{
+	char *buf = malloc(in_len * 2 + 1);
+	if (!buf) {
+		err("Failed to allocate memory for hex string.\n");
+		return -1;
+	}
+
+	for (unsigned long i = 0; i < in_len; ++i)
+		sprintf(buf + i * 2, "%02x", in[i]);
+
+	buf[in_len * 2] = 0;
+	*out = buf;
+
+	return 0;
+}
+
+static int
+hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+int
+cryptfs_tpm2_util_hex_decode(const char *in, unsigned long in_len,
+			     uint8_t **out, unsigned long *out_len)
+{
+	unsigned long len = in_len;
+
+	/* Tolerate the trailing newline in the file */
+	while (len && (in[len - 1] == '\n' || in[len - 1] == '\r'))
+		--len;
+
+	if (!len || len % 2) {
+		err("Invalid length of hex string.\n");
+		return -1;
+	}
+
+	uint8_t *buf = malloc(len / 2);
+	if (!buf) {
+		err("Failed to allocate memory for hex string.\n");
+		return -1;
+	}
+
+	for (unsigned long i = 0; i < len; i += 2) {
+		int hi = hex_value(in[i]);
+		int lo = hex_value(in[i + 1]);
+
+		if (hi < 0 || lo < 0) {
+			free(buf);
+			err("Invalid character in hex string.\n");
+			return -1;
+		}
+
+		buf[i / 2] = (hi << 4) | lo;
+	}
+
+	*out = buf;
+	*out_len = len / 2;
+
+	return 0;
+}
+
+int
+cryptfs_tpm2_util_write_fd(int fd, const uint8_t *buf, unsigned long size)
+{
+	while (size) {
+		ssize_t len = write(fd, buf, size);
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			err("Failed to write fd %d (%s)\n", fd, strerror(errno));
+			return -1;
+		}
+
+		buf += len;
+		size -= len;
+	}
+
+	return 0;
+}
+
+/*
+ * Place the data in a sealed memfd. If memfd is not available, fall back
+ * to a pipe which is large enough to buffer the secret.
+ */
+static int
+create_input_fd(const uint8_t *buf, unsigned long size)
+{
+	int fd = syscall(__NR_memfd_create, "cryptfs-tpm2",
+			 MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd >= 0) {
+		if (cryptfs_tpm2_util_write_fd(fd, buf, size) ||
+		    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+				       F_SEAL_WRITE | F_SEAL_SEAL) ||
+		    lseek(fd, 0, SEEK_SET)) {
+			err("Failed to prepare memfd\n");
+			close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	dbg("memfd unavailable (%s), falling back to pipe\n",
+	    strerror(errno));
+
+	if (size > PIPE_BUF) {
+		err("Secret too large for pipe\n");
+		return -1;
+	}
+
+	int pipe_fd[2];
+
+	if (pipe2(pipe_fd, O_CLOEXEC)) {
+		err("Failed to create pipe (%s)\n", strerror(errno));
+		return -1;
+	}
+
+	int rc = cryptfs_tpm2_util_write_fd(pipe_fd[1], buf, size);
+
+	close(pipe_fd[1]);
+	if (rc) {
+		close(pipe_fd[0]);
+		return -1;
+	}
+
+	return pipe_fd[0];
+}
+
+/*
+ * Run the command with /bin/sh and hand over the data without touching
+ * any filesystem. The data is readable from the standard input of the
+ * command. In addition, the fd is inherited and exported as
+ * CRYPTFS_TPM2_KEY_FD. If it refers to a memfd, the command may reopen
+ * /proc/self/fd/$CRYPTFS_TPM2_KEY_FD as many times as needed.
+ *
+ * Return the exit status of the command, or -1 on failure.
+ */
+int
+cryptfs_tpm2_util_exec_with_input(const char *cmd, const uint8_t *buf,
+				  unsigned long size)
+{
+	int fd = create_input_fd(buf, size);
+	if (fd < 0)
+		return -1;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		err("Failed to fork (%s)\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if (!pid) {
+		char fd_str[16];
+
+		/* dup2() doesn't preserve FD_CLOEXEC on the new fd */
+		if (dup2(fd, STDIN_FILENO) < 0 ||
+		    fcntl(fd, F_SETFD, 0))
+			_exit(127);
+
+		snprintf(fd_str, sizeof(fd_str), "%d", fd);
+		setenv("CRYPTFS_TPM2_KEY_FD", fd_str, 1);
+
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		_exit(127);
+	}
+
+	close(fd);
+
+	int status;
+
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			err("Failed to wait for the command (%s)\n",
+			    strerror(errno));
+			return -1;
+		}
+	}
+
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+
+	err("The command terminated by signal %d\n", WTERMSIG(status));
+
+	return -1;
+}
+
 int
 get_input(const char *prompt, uint8_t *buf, unsigned int *buf_len)
 {
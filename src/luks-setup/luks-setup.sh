@@ -76,6 +76,9 @@ OPT_INTERACTIVE=0
 OPT_OLD_LOCKOUT_AUTH=""
 OPT_LOUCKOUT_AUTH=""
 OPT_NO_RECOVERY=0
+OPT_VOLUME_KEY=0
+OPT_FAST_PBKDF=1
+OPT_BLOB=0
 # Depreciated
 OPT_MAP_EXISTING_LUKS=0
 # Depreciated
@@ -131,6 +134,29 @@ Options:
  -R|--skip-recovery
     (Optional) Skip enrolling recovery keyslot.
 
+ -k|--volume-key
+    (Optional) Seal the LUKS volume key into TPM in place of the passphrase,
+    so the volume is opened without running the keyslot KDF (e.g, argon2id).
+    The keyslot for the unsealed passphrase is removed, so only the sealed
+    volume key and the recovery keyslot are able to unlock the volume.
+    LUKS1 is not supported.
+
+ -b|--blob
+    (Optional) Store the sealed passphrase (or volume key) as a blob in the
+    LUKS2 token instead of a persistent handle in TPM. The blob is loaded
+    and flushed on each unlock, so the LUKS volumes don't compete for the
+    limited persistent handles. LUKS1 is not supported.
+
+ --no-fast-pbkdf
+    (Optional) Use the default memory-hard PBKDF (e.g, argon2id) for the
+    keyslot of the unsealed passphrase.
+
+    By default, the keyslot of the unsealed passphrase uses PBKDF2 with the
+    minimal iterations. The passphrase is 64 bytes of TPM randomness so a
+    costly PBKDF adds no brute-force protection, but slows down the unlock
+    and needs hundreds of MB memory. The recovery keyslot keeps the default
+    PBKDF.
+
  -E|--nodeps
     (Optional) Don't exit due to the unmet dependency.
 
@@ -369,10 +395,12 @@ configure_tpm() {
     local pcr_opt=""
     [ $OPT_USE_PCR -eq 1 ] && pcr_opt="-P auto"
 
+    # The TCG SRK at 0x81000001, if provisioned and compatible, is used
+    # as the parent of passphrase in place of the primary key.
     if ! tpm_getcap handles-persistent | grep -qi 0x817FFFFF; then
         print_verbose "Sealing the primary key into TPM ..."
 
-        if ! cryptfs-tpm2 -q seal key $pcr_opt; then
+        if ! cryptfs-tpm2 -q seal key --parent auto $pcr_opt; then
             print_error "[!] Unable to seal the primary key"
             return 1
         fi
@@ -380,10 +408,13 @@ configure_tpm() {
         print_info "Sealed the primary key into TPM"
     fi
 
-    if ! tpm_getcap handles-persistent | grep -qi 0x817FFFFE; then
+    # The blob is sealed on the creation of LUKS volume
+    if [ $OPT_BLOB -eq 1 ]; then
+        print_verbose "Skip sealing the passphrase into TPM in favor of the blob"
+    elif ! tpm_getcap handles-persistent | grep -qi 0x817FFFFE; then
         print_info "Sealing the passphrase into TPM ..."
 
-        if ! cryptfs-tpm2 -q seal passphrase $pcr_opt; then
+        if ! cryptfs-tpm2 -q seal passphrase --parent auto $pcr_opt; then
             print_error "[!] Unable to seal the passphrase"
             return 1
         fi
@@ -398,6 +429,7 @@ retrieve_passphrase() {
     print_verbose "[?] Retrieving the passphrase ..."
 
     local type="$1"
+    local luks_dev="$2"
     if [ "$type" = "luks-setup-deriving" ] || [ "$type" = "luks-setup-deriving-recovery" ]; then
         PASSPHRASE="$TEMP_DIR/passphrase"
         if [ -s "$PASSPHRASE" ]; then
@@ -419,7 +451,7 @@ retrieve_passphrase() {
     elif [ "$type" = "luks-setup-prompt-recovery" ]; then
         print_info "[!] Skip to automatically retrieve the recovery passphrase"
         return 0
-    elif [ "$type" != "luks-setup-unsealing" ]; then
+    elif [ "$type" != "luks-setup-unsealing" ] && [ "$type" != "luks-setup-unsealing-volume-key" ]; then
         print_info "[!] Unrecognized token type \"$type\""
         return 1
     fi
@@ -440,7 +472,25 @@ retrieve_passphrase() {
         local pcr_opt=""
         [ $OPT_USE_PCR -eq 1 ] && pcr_opt="-P auto"
 
-        if ! cryptfs-tpm2 -q unseal passphrase $pcr_opt -o "$PASSPHRASE"; then
+        # The existing LUKS volume carries the blob in its token, and the
+        # blob is sealed for the LUKS volume to be created.
+        local blob="$TEMP_DIR/blob"
+        if [ -n "$luks_dev" ] && [ ! -s "$blob" ]; then
+            local hex="$(get_token_blob "$luks_dev" "$type")"
+            [ -n "$hex" ] && echo -n "$hex" > "$blob"
+        elif [ -z "$luks_dev" ] && [ $OPT_BLOB -eq 1 ] && [ ! -s "$blob" ]; then
+            if ! cryptfs-tpm2 -q seal passphrase --parent auto $pcr_opt --blob "$blob"; then
+                print_error "[!] Unable to seal the passphrase to the blob"
+                return 1
+            fi
+
+            print_verbose "Sealed the passphrase to the blob"
+        fi
+
+        local blob_opt=""
+        [ -s "$blob" ] && blob_opt="--blob $blob"
+
+        if ! cryptfs-tpm2 -q unseal passphrase $pcr_opt $blob_opt -o "$PASSPHRASE"; then
             print_error "[!] Unable to unseal the passphrase with cryptfs-tpm2"
             return 1
         fi
@@ -464,9 +514,14 @@ enroll_token() {
     local type="$2"
     local desc=""
     local keyslot="0"
+    local keyslots=""
 
     if [ "$type" = "luks-setup-unsealing" ]; then
         desc="unsealed passphrase"
+    elif [ "$type" = "luks-setup-unsealing-volume-key" ]; then
+        # The volume key doesn't occupy any keyslot
+        desc="unsealed volume key"
+        keyslots="[]"
     elif [ "$type" = "luks-setup-deriving" ]; then
         desc="derived passphrase"
     elif [ "$type" = "luks-setup-prompt" ]; then
@@ -484,7 +539,19 @@ enroll_token() {
     print_verbose "[?] Enrolling a new token for the $desc ..."
 
     local luks_dev="$1"
-    local token="{\"type\":\"$type\",\"keyslots\":[\"$keyslot\"], \"description\": \"$desc\"}"
+    keyslots="${keyslots:-[\"$keyslot\"]}"
+
+    # Tell the token plugin which PCR bank the sealed object is bound to
+    local pcr_bank=""
+    [ $OPT_USE_PCR -eq 1 ] && [[ "$type" == luks-setup-unsealing* ]] &&
+        pcr_bank=", \"pcr_bank\": \"auto\""
+
+    # The sealed object is carried by the token in the blob mode
+    local blob=""
+    [ -s "$TEMP_DIR/blob" ] && [[ "$type" == luks-setup-unsealing* ]] &&
+        blob=", \"blob\": \"$(cat "$TEMP_DIR/blob")\""
+
+    local token="{\"type\":\"$type\",\"keyslots\":$keyslots, \"description\": \"$desc\"$pcr_bank$blob}"
     if ! echo -n "$token" | cryptsetup token import "$luks_dev"; then
         print_error "[!] Failed to enroll a new token for the $desc"
         return 1
@@ -513,6 +580,10 @@ create_luks_volume() {
         cmd="$cmd --key-file $PASSPHRASE"
     fi
 
+    # PBKDF2 with 1000 iterations is the minimal cost allowed by cryptsetup
+    [ "$type" = "luks-setup-unsealing" ] && [ $OPT_FAST_PBKDF -eq 1 ] &&
+        cmd="$cmd --pbkdf pbkdf2 --pbkdf-force-iterations 1000"
+
     [ $OPT_INTERACTIVE -eq 0 ] && cmd="$cmd --batch-mode"
     if ! eval "$cmd"; then
         print_error "[!] Unable to create the LUKS volume on $luks_dev"
@@ -520,6 +591,17 @@ create_luks_volume() {
     fi
 
     # LUKS version 1 doesn't support token
+    if cryptsetup isLuks --type luks1 "$luks_dev" && [ -s "$TEMP_DIR/blob" ]; then
+        print_error "[!] The blob cannot be stored in the LUKS1 volume \"$luks_name\""
+        return 1
+    fi
+
+    # The token type records whether the volume key is sealed
+    if cryptsetup isLuks --type luks1 "$luks_dev" && [ $OPT_VOLUME_KEY -eq 1 ]; then
+        print_error "[!] The volume key cannot be sealed for the LUKS1 volume \"$luks_name\""
+        return 1
+    fi
+
     cryptsetup isLuks --type luks1 "$luks_dev" && NO_TOKEN_IMPORT=1 || {
         if ! enroll_token "$luks_dev" "$type"; then
             print_error "[!] Unable to enroll a new token on the creation for the LUKS volume \"$luks_name\" ..."
@@ -530,6 +612,43 @@ create_luks_volume() {
     print_info "[!] Created the LUKS volume \"$luks_name\" on the backing device \"$luks_dev\""
 }
 
+# Print the keyslot bound to the token of the specified type
+get_token_keyslot() {
+    local luks_dev="$1"
+    local type="$2"
+    local id
+
+    [ $NO_TOKEN_IMPORT -eq 1 ] && return 1
+
+    # The token for the primary passphrase and recovery are enrolled first
+    for id in 0 1; do
+        local token="$(cryptsetup token export --token-id $id "$luks_dev" 2>/dev/null)"
+
+        echo "$token" | grep -q "\"type\":[[:space:]]*\"$type\"" || continue
+
+        echo "$token" | sed -n 's/.*"keyslots":[[:space:]]*\[[[:space:]]*"\([0-9]*\)".*/\1/p'
+        return 0
+    done
+
+    return 1
+}
+
+# Print the hex string of the sealed object blob in the token of the
+# specified type
+get_token_blob() {
+    local luks_dev="$1"
+    local type="$2"
+
+    [ $NO_TOKEN_IMPORT -eq 1 ] && return 1
+
+    # The token for the primary passphrase is enrolled first
+    local token="$(cryptsetup token export --token-id 0 "$luks_dev" 2>/dev/null)"
+
+    echo "$token" | grep -q "\"type\":[[:space:]]*\"$type\"" || return 1
+
+    echo "$token" | sed -n 's/.*"blob":[[:space:]]*"\([0-9a-fA-F]*\)".*/\1/p'
+}
+
 map_luks_volume() {
     local luks_name="$2"
     local type="$3"
@@ -541,16 +660,24 @@ map_luks_volume() {
         return 1
     fi
 
-    ! retrieve_passphrase "$type" && return $?
+    ! retrieve_passphrase "$type" "$1" && return $?
 
     local luks_dev="$1"
 
     local cmd="cryptsetup luksOpen $luks_dev $luks_name"
 
-    if [ "$type" != "luks-setup-prompt" ]; then
+    if [ "$type" = "luks-setup-unsealing-volume-key" ]; then
+        cmd="$cmd --master-key-file $PASSPHRASE"
+    elif [ "$type" != "luks-setup-prompt" ]; then
         cmd="$cmd --key-file $PASSPHRASE"
     fi
 
+    # Avoid running the KDF of every keyslot until one matches
+    if [ "$type" != "luks-setup-unsealing-volume-key" ]; then
+        local keyslot="$(get_token_keyslot "$luks_dev" "$type")"
+        [ -n "$keyslot" ] && cmd="$cmd --key-slot $keyslot"
+    fi
+
     if ! eval "$cmd"; then
         print_error "[!] Unable to map the LUKS volume \"$luks_name\" with the token \"$type\""
         return 1
@@ -578,6 +705,88 @@ unmap_luks_volume() {
     print_info "[!] The LUKS volume \"$luks_name\" unmapped"
 }
 
+# Replace the sealed passphrase with the volume key of the LUKS volume
+# created with the unsealed passphrase.
+seal_volume_key() {
+    print_verbose "[?] Sealing the volume key into TPM ..."
+
+    local luks_dev="$1"
+    local volume_key="$TEMP_DIR/volume_key"
+
+    # Without the token, the volume key cannot be told from the passphrase
+    # at the unlock time
+    if [ $NO_TOKEN_IMPORT -eq 1 ]; then
+        print_error "[!] Unable to seal the volume key without the token support"
+        return 1
+    fi
+
+    # The status of the negated command is always 0
+    ! retrieve_passphrase "luks-setup-unsealing" && return 1
+
+    if ! cryptsetup luksDump "$luks_dev" --dump-master-key --master-key-file "$volume_key" \
+        --key-file "$PASSPHRASE" --batch-mode >/dev/null; then
+        print_error "[!] Unable to retrieve the volume key"
+        rm -f "$volume_key"
+        return 1
+    fi
+
+    local pcr_opt=""
+    [ $OPT_USE_PCR -eq 1 ] && pcr_opt="-P auto"
+
+    if [ $OPT_BLOB -eq 1 ]; then
+        # The blob of the volume key replaces the one of the passphrase
+        # in the token, so nothing in TPM needs to be evicted.
+        if ! cryptfs-tpm2 -q seal volume-key -p "$volume_key" --parent auto $pcr_opt \
+            --blob "$TEMP_DIR/volume_key_blob"; then
+            print_error "[!] Unable to seal the volume key to the blob"
+            rm -f "$volume_key" "$TEMP_DIR/volume_key_blob"
+            return 1
+        fi
+
+        mv -f "$TEMP_DIR/volume_key_blob" "$TEMP_DIR/blob"
+    else
+        if ! cryptfs-tpm2 -q evict passphrase; then
+            print_error "[!] Failed to evict the passphrase"
+            rm -f "$volume_key"
+            return 1
+        fi
+
+        if ! cryptfs-tpm2 -q seal volume-key -p "$volume_key" $pcr_opt; then
+            print_error "[!] Unable to seal the volume key"
+
+            # Restore the passphrase to keep the LUKS volume accessible
+            if ! cryptfs-tpm2 -q seal passphrase -p "$PASSPHRASE" $pcr_opt; then
+                print_critical "[!] Unable to restore the passphrase. TPM no longer holds any secret for \"$luks_dev\", which can only be unlocked with the recovery keyslot if enrolled"
+            fi
+
+            rm -f "$volume_key"
+            return 1
+        fi
+    fi
+
+    rm -f "$volume_key"
+
+    # The passphrase is no longer available from TPM
+    if ! cryptsetup luksRemoveKey "$luks_dev" --key-file "$PASSPHRASE" --batch-mode; then
+        print_warning "[!] Unable to remove the keyslot for the unsealed passphrase"
+    fi
+
+    rm -f "$PASSPHRASE"
+
+    TOKEN_TYPE="luks-setup-unsealing-volume-key"
+
+    if [ $NO_TOKEN_IMPORT -eq 0 ]; then
+        if ! cryptsetup token remove --token-id 0 "$luks_dev"; then
+            print_error "[!] Unable to remove the token for the unsealed passphrase"
+            return 1
+        fi
+
+        ! enroll_token "$luks_dev" "$TOKEN_TYPE" && return 1
+    fi
+
+    print_info "[!] Sealed the volume key into TPM"
+}
+
 enroll_recovery_keyslot() {
     print_verbose "[?] Enrolling a new keyslot ..."
 
@@ -598,7 +807,12 @@ enroll_recovery_keyslot() {
     ! retrieve_passphrase "$type" && return $?
 
     local luks_dev="$1"
-    if ! cryptsetup luksAddKey "$luks_dev" "$passphrase" --key-file "$PASSPHRASE"; then
+    # The recovery passphrase may be typed by human so keep the memory-hard
+    # PBKDF for it, regardless of the one used by the unsealed passphrase.
+    local pbkdf_opt=""
+    cryptsetup isLuks --type luks2 "$luks_dev" && pbkdf_opt="--pbkdf argon2id"
+
+    if ! cryptsetup luksAddKey "$luks_dev" "$passphrase" --key-file "$PASSPHRASE" $pbkdf_opt; then
         print_error "[!] Unable to enroll new keyslot"
         return 1
     fi
@@ -739,6 +953,15 @@ main() {
             -R|--skip-recovery)
                 OPT_NO_RECOVERY=1
                 ;;
+            -k|--volume-key)
+                OPT_VOLUME_KEY=1
+                ;;
+            -b|--blob)
+                OPT_BLOB=1
+                ;;
+            --no-fast-pbkdf)
+                OPT_FAST_PBKDF=0
+                ;;
             -E|--nodeps)
                 OPT_NO_DEPS=1
                 ;;
@@ -846,6 +1069,11 @@ main() {
         if [ $OPT_FORCE_CREATION -eq 0 ]; then
             print_info "Skip the creation of LUKS volume unless specifying --force"
 
+            [ "$TOKEN_TYPE" = "luks-setup-unsealing" ] &&
+                cryptsetup token export --token-id 0 "$OPT_LUKS_DEV" 2>/dev/null |
+                    grep -q "luks-setup-unsealing-volume-key" &&
+                TOKEN_TYPE="luks-setup-unsealing-volume-key"
+
             if [ $OPT_RECOVERY -eq 0 ]; then
                 map_luks_volume "$OPT_LUKS_DEV" "$OPT_LUKS_NAME" "$TOKEN_TYPE"
             else
@@ -876,6 +1104,17 @@ main() {
         ! enroll_recovery "$OPT_LUKS_DEV" "$RECOVERY_TYPE" && exit $?
     fi
 
+    if [ $OPT_VOLUME_KEY -eq 1 ]; then
+        if [ "$TOKEN_TYPE" != "luks-setup-unsealing" ]; then
+            print_warning "Skip sealing the volume key due to TPM not used"
+        else
+            [ $OPT_NO_RECOVERY -eq 1 ] &&
+                print_warning "The sealed volume key will be the only way to unlock the LUKS volume"
+
+            ! seal_volume_key "$OPT_LUKS_DEV" && exit 1
+        fi
+    fi
+
     if [ $OPT_UNMAP_LUKS -eq 0 ]; then
         ! map_luks_volume "$OPT_LUKS_DEV" "$OPT_LUKS_NAME" "$TOKEN_TYPE" && exit 1
     fi
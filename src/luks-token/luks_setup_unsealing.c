@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2024, Alibaba Cloud
+ * Copyright (c) 2016-2023, Wind River Systems, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1) Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2) Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3) Neither the name of Wind River Systems nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author:
+ *        Jia Zhang <zhang.jia@linux.alibaba.com>
+ */
+
+/*
+ * The LUKS2 token plugin for the token type luks-setup-unsealing enrolled
+ * by luks-setup. libcryptsetup loads it as
+ * libcryptsetup-token-luks-setup-unsealing.so and uses the unsealed
+ * passphrase to open the keyslots bound to the token.
+ */
+
+#include <cryptfs_tpm2.h>
+#include <libcryptsetup.h>
+
+#define TOKEN_TYPE		"luks-setup-unsealing"
+
+/* The hex string of the sealed object blob is far less than 1KB */
+#define BLOB_HEX_MAX_SIZE	2048
+
+/*
+ * Extract the string value of a top-level key from the token json. The
+ * token written by luks-setup is flat so a full json parser is not
+ * required.
+ */
+static const char *
+json_string_end(const char *p)
+{
+	for (; *p && *p != '"'; ++p) {
+		if (*p == '\\' && *(p + 1))
+			++p;
+	}
+
+	return *p ? p : NULL;
+}
+
+static int
+json_get_string(const char *json, const char *key, char *value,
+		size_t value_size)
+{
+	size_t key_len = strlen(key);
+	const char *p = json;
+
+	while ((p = strchr(p, '"'))) {
+		const char *str = p + 1;
+		const char *end = json_string_end(str);
+
+		if (!end)
+			break;
+
+		p = end + 1;
+		while (isspace(*p))
+			++p;
+
+		/* Only a string followed by a colon is a key */
+		if (*p != ':' || (size_t)(end - str) != key_len ||
+		    strncmp(str, key, key_len))
+			continue;
+
+		++p;
+		while (isspace(*p))
+			++p;
+		if (*p++ != '"')
+			return -EINVAL;
+
+		end = json_string_end(p);
+		if (!end || (size_t)(end - p) >= value_size)
+			return -EINVAL;
+
+		memcpy(value, p, end - p);
+		value[end - p] = '\0';
+
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+static int
+parse_pcr_bank(const char *json, TPMI_ALG_HASH *pcr_bank_alg)
+{
+	char bank[16];
+	int rc;
+
+	rc = json_get_string(json, "pcr_bank", bank, sizeof(bank));
+	if (rc == -ENOENT) {
+		*pcr_bank_alg = TPM2_ALG_NULL;
+		return 0;
+	} else if (rc)
+		return rc;
+
+	if (!strcasecmp(bank, "sha1"))
+		*pcr_bank_alg = TPM2_ALG_SHA1;
+	else if (!strcasecmp(bank, "sha256"))
+		*pcr_bank_alg = TPM2_ALG_SHA256;
+	else if (!strcasecmp(bank, "sha384"))
+		*pcr_bank_alg = TPM2_ALG_SHA384;
+	else if (!strcasecmp(bank, "sha512"))
+		*pcr_bank_alg = TPM2_ALG_SHA512;
+	else if (!strcasecmp(bank, "sm3_256"))
+		*pcr_bank_alg = TPM2_ALG_SM3_256;
+	else if (!strcasecmp(bank, "auto"))
+		*pcr_bank_alg = TPM2_ALG_AUTO;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * The passphrase object is loaded from the blob in the token if any,
+ * otherwise unsealed from the persistent handle.
+ */
+static int
+unseal_passphrase(const char *json, TPMI_ALG_HASH pcr_bank_alg,
+		  void **passphrase, size_t *passphrase_size)
+{
+	char *hex = malloc(BLOB_HEX_MAX_SIZE + 1);
+	if (!hex)
+		return -ENOMEM;
+
+	int rc = json_get_string(json, "blob", hex, BLOB_HEX_MAX_SIZE + 1);
+	if (rc == -ENOENT) {
+		free(hex);
+		return cryptfs_tpm2_unseal_passphrase(pcr_bank_alg, passphrase,
+						      passphrase_size);
+	} else if (rc) {
+		free(hex);
+		return rc;
+	}
+
+	uint8_t *blob;
+	unsigned long blob_size;
+
+	rc = cryptfs_tpm2_util_hex_decode(hex, strlen(hex), &blob,
+					  &blob_size);
+	free(hex);
+	if (rc)
+		return rc;
+
+	rc = cryptfs_tpm2_unseal_passphrase_blob(pcr_bank_alg, blob,
+						 blob_size, passphrase,
+						 passphrase_size);
+	free(blob);
+
+	return rc;
+}
+
+/*
+ * Forward the messages of libcryptfs-tpm2 to libcryptsetup rather than
+ * writing to stdout/stderr of the host process.
+ */
+static void
+log_handler(int level, const char *msg, void *data)
+{
+	struct crypt_device *cd = data;
+	int crypt_level;
+
+	switch (level) {
+	case CRYPTFS_TPM2_LOG_FAULT:
+	case CRYPTFS_TPM2_LOG_ERROR:
+		crypt_level = CRYPT_LOG_ERROR;
+		break;
+	case CRYPTFS_TPM2_LOG_DEBUG:
+		crypt_level = CRYPT_LOG_DEBUG;
+		break;
+	default:
+		crypt_level = CRYPT_LOG_VERBOSE;
+		break;
+	}
+
+	crypt_log(cd, crypt_level, msg);
+}
+
+const char *
+cryptsetup_token_version(void)
+{
+	return VERSION;
+}
+
+int
+cryptsetup_token_open(struct crypt_device *cd, int token, char **buffer,
+		      size_t *buffer_len, void *usrptr)
+{
+	const char *json;
+	TPMI_ALG_HASH pcr_bank_alg;
+	int rc;
+
+	rc = crypt_token_json_get(cd, token, &json);
+	if (rc < 0)
+		return rc;
+
+	if (parse_pcr_bank(json, &pcr_bank_alg))
+		return -EINVAL;
+
+	cryptfs_tpm2_util_set_log_handler(log_handler, cd);
+
+	if (pcr_bank_alg != TPM2_ALG_NULL &&
+	    cryptfs_tpm2_capability_pcr_bank_supported(&pcr_bank_alg) == false) {
+		cryptfs_tpm2_util_set_log_handler(NULL, NULL);
+		crypt_log(cd, CRYPT_LOG_ERROR, "Unsupported PCR bank\n");
+		return -EINVAL;
+	}
+
+	void *passphrase;
+	size_t passphrase_size;
+
+	rc = unseal_passphrase(json, pcr_bank_alg, &passphrase,
+			       &passphrase_size);
+
+	/* The crypt device is not valid beyond this call */
+	cryptfs_tpm2_util_set_log_handler(NULL, NULL);
+
+	if (rc) {
+		crypt_log(cd, CRYPT_LOG_ERROR,
+			  "Unable to unseal the passphrase\n");
+		return -EACCES;
+	}
+
+	*buffer = passphrase;
+	*buffer_len = passphrase_size;
+
+	return 0;
+}
+
+void
+cryptsetup_token_buffer_free(void *buffer, size_t buffer_len)
+{
+	memset(buffer, 0, buffer_len);
+	free(buffer);
+}
+
+int
+cryptsetup_token_validate(struct crypt_device *cd, const char *json)
+{
+	TPMI_ALG_HASH pcr_bank_alg;
+
+	if (parse_pcr_bank(json, &pcr_bank_alg)) {
+		crypt_log(cd, CRYPT_LOG_ERROR,
+			  "Invalid pcr_bank in " TOKEN_TYPE " token\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+void
+cryptsetup_token_dump(struct crypt_device *cd, const char *json)
+{
+	char bank[16];
+	char msg[64];
+
+	if (json_get_string(json, "pcr_bank", bank, sizeof(bank)))
+		strcpy(bank, "none");
+
+	snprintf(msg, sizeof(msg), "\tPCR bank:   %s\n", bank);
+	crypt_log(cd, CRYPT_LOG_NORMAL, msg);
+
+	snprintf(msg, sizeof(msg), "\tBlob:       %s\n",
+		 strstr(json, "\"blob\"") ? "yes" : "no");
+	crypt_log(cd, CRYPT_LOG_NORMAL, msg);
+}
@@ -65,6 +65,7 @@ show_usage(const char *prog)
 	info_cont("  help: Display the help information for the "
 		  "specified command\n");
 	info_cont("  wait: wait for the resource manager getting ready\n");
+	info_cont("  wait-dev: wait for the block device showing up\n");
 }
 
 static int
@@ -120,6 +121,7 @@ parse_options(int argc, char *argv[])
 
 extern subcommand_t subcommand_help;
 extern subcommand_t subcommand_wait;
+extern subcommand_t subcommand_wait_dev;
 
 static void
 exit_notify(void)
@@ -136,6 +138,7 @@ main(int argc, char *argv[], char *envp[])
 
 	subcommand_add(&subcommand_help);
 	subcommand_add(&subcommand_wait);
+	subcommand_add(&subcommand_wait_dev);
 
 	int rc = parse_options(argc, argv);
 	if (rc)
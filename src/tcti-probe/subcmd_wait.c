@@ -40,14 +40,27 @@
 static unsigned long opt_delay_ms = DEFAULT_DELAY_MSEC;
 static unsigned long opt_timeout_ms = DEFAULT_TIMEOUT_MSEC;
 
+/*
+ * Only the TPM device nodes (tpm* and tpmrm*) under /dev are watched.
+ * tabrmd becomes reachable by claiming its name on a D-Bus system bus
+ * which is usually up long before, so nothing on the filesystem tells
+ * when it is ready, and the backoff polling is the way to await it.
+ */
+#define WATCH_DIR			"/dev"
+#define WATCH_PREFIX			"tpm"
+
 static void
 show_usage(char *prog)
 {
 	info_cont("\nUsage: %s <options> wait <args>\n", prog);
 	info_cont("\nargs:\n");
 	info_cont("  --delay, -d:\n"
-		  "    (optional)The delay (in millisecond) before\n"
-		  "    attempting to connecting the resource manager.\n"
+		  "    (optional) The maximum interval (in millisecond)\n"
+		  "    between two attempts of connecting the resource\n"
+		  "    manager. The attempt is triggered immediately if\n"
+		  "    the TPM device node shows up in /dev. Otherwise,\n"
+		  "    e.g, for tabrmd, the interval backs off from 1ms\n"
+		  "    up to this value.\n"
 		  "    Default: %ld\n", DEFAULT_DELAY_MSEC);
 	info_cont("  --timeout, -t:\n"
 		  "    (optional) The timeout (in millisecond) upon\n"
@@ -78,58 +91,137 @@ parse_arg(int opt, char *optarg)
 	return 0;
 }
 
-static void
-accurate_delay_begin(void)
+static unsigned long
+now_ms(void)
 {
-	struct sched_param param;
-	int policy = SCHED_RR;
+	struct timespec ts;
 
-	param.sched_priority = sched_get_priority_max(policy);
-	sched_setscheduler(0, policy, &param);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
 }
 
-static void
-accurate_delay(unsigned long delay_ms)
+static int
+watch_init(void)
 {
-	struct timespec req;
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
 
-	req.tv_sec = delay_ms / 1000;
-	delay_ms %= 1000;
-	req.tv_nsec = delay_ms * 1000000;
+	if (fd < 0) {
+		dbg("Unable to initialize inotify (%s)\n", strerror(errno));
+		return -1;
+	}
 
-	while (1) {
-		struct timespec rem;
-		int err;
+	if (inotify_add_watch(fd, WATCH_DIR, IN_CREATE | IN_ATTRIB |
+			      IN_MOVED_TO) < 0) {
+		dbg("Unable to watch %s (%s)\n", WATCH_DIR, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * Drain the pending events and tell whether any of them is about the
+ * TPM device nodes.
+ */
+static bool
+watch_read(int fd)
+{
+	char buf[4096]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	bool relevant = false;
+	ssize_t len;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + len;) {
+			struct inotify_event *ev = (struct inotify_event *)p;
+
+			if (ev->len && !strncmp(ev->name, WATCH_PREFIX,
+						sizeof(WATCH_PREFIX) - 1))
+				relevant = true;
+
+			p += sizeof(*ev) + ev->len;
+		}
+	}
+
+	return relevant;
+}
 
-		err = nanosleep(&req, &rem);
-		if (!err || errno != EINTR)
+/*
+ * Sleep until a TPM device node shows up, or the specified time elapses
+ * as the fallback. Return true only in the former case.
+ */
+static bool
+watch_wait(int fd, unsigned long wait_ms)
+{
+	if (fd < 0) {
+		struct timespec req = {
+			.tv_sec = wait_ms / 1000,
+			.tv_nsec = (wait_ms % 1000) * 1000000,
+		};
+
+		while (nanosleep(&req, &req) && errno == EINTR)
+			;
+
+		return false;
+	}
+
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = POLLIN,
+	};
+	unsigned long deadline_ms = now_ms() + wait_ms;
+
+	/* The unrelated events in /dev don't cut the sleep short */
+	while (poll(&pfd, 1, wait_ms) > 0) {
+		if (watch_read(fd) == true)
+			return true;
+
+		unsigned long cur_ms = now_ms();
+
+		if (cur_ms >= deadline_ms)
 			break;
 
-		req = rem;
+		wait_ms = deadline_ms - cur_ms;
 	}
+
+	return false;
+}
+
+static bool
+probe_tpm(void)
+{
+	if (cryptfs_tpm2_init() == EXIT_SUCCESS &&
+	    cryptfs_tpm2_capability_ping() == EXIT_SUCCESS)
+		return true;
+
+	/*
+	 * Reconnect from scratch at the next attempt. The tabrmd tcti
+	 * library is kept loaded.
+	 */
+	cryptfs_tpm2_teardown();
+
+	return false;
 }
 
 static int
 run_wait(char *prog)
 {
-	TSS2_TCTI_CONTEXT *context = NULL;
-	unsigned long total_delay_ms = 0;
+	unsigned long start_ms = now_ms();
+	unsigned long backoff_ms = 1;
 	int ret = EXIT_SUCCESS;
 
-	accurate_delay_begin();
+	/* Watch before the first attempt so that no event is missed */
+	int fd = watch_init();
 
 	while (1) {
-		context = cryptfs_tpm2_tcti_init_context();
-		if (context) {
+		if (probe_tpm() == true) {
 			info("The resource manager is getting ready\n");
 			break;
 		}
 
-		if (total_delay_ms + opt_delay_ms > opt_timeout_ms &&
-		    opt_timeout_ms)
-			opt_delay_ms = opt_timeout_ms - total_delay_ms;
-		accurate_delay(opt_delay_ms);
-		total_delay_ms += opt_delay_ms;
+		unsigned long total_delay_ms = now_ms() - start_ms;
 
 		dbg("Already waited for the resource manager %ld "
 		    "millisecond\n", total_delay_ms);
@@ -139,10 +231,31 @@ run_wait(char *prog)
 			ret = EXIT_FAILURE;
 			break;
 		}
+
+		unsigned long wait_ms = backoff_ms;
+
+		if (total_delay_ms + wait_ms > opt_timeout_ms &&
+		    opt_timeout_ms)
+			wait_ms = opt_timeout_ms - total_delay_ms;
+
+		/*
+		 * The resource manager usually follows the device node
+		 * closely, so start over with the short interval.
+		 */
+		if (watch_wait(fd, wait_ms) == true) {
+			backoff_ms = 1;
+			continue;
+		}
+
+		backoff_ms *= 2;
+		if (backoff_ms > opt_delay_ms)
+			backoff_ms = opt_delay_ms;
 	}
 
-	if (context)
-		cryptfs_tpm2_tcti_teardown_context(context);
+	if (fd >= 0)
+		close(fd);
+
+	cryptfs_tpm2_teardown();
 
 	return ret;
 }
@@ -0,0 +1,666 @@
+/*
+ * Copyright (c) 2024, Alibaba Cloud
+ * Copyright (c) 2016-2023, Wind River Systems, Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1) Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2) Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3) Neither the name of Wind River Systems nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Author:
+ *        Jia Zhang <zhang.jia@linux.alibaba.com>
+ */
+
+#include <cryptfs_tpm2.h>
+
+#define DEFAULT_TIMEOUT_MSEC		6000UL
+#define POLL_INTERVAL_MSEC		100UL
+
+#define LUKS_MAGIC			"LUKS\xba\xbe"
+#define LUKS_MAGIC_SIZE			6
+#define LUKS_VERSION_OFFSET		6
+#define LUKS2_VERSION			2
+#define LUKS_LABEL_OFFSET		24
+#define LUKS_LABEL_SIZE			48
+#define LUKS_UUID_OFFSET		168
+#define LUKS_UUID_SIZE			40
+
+#define EXT_SB_OFFSET			1024
+#define EXT_MAGIC_OFFSET		(EXT_SB_OFFSET + 56)
+#define EXT_UUID_OFFSET			(EXT_SB_OFFSET + 104)
+#define EXT_LABEL_OFFSET		(EXT_SB_OFFSET + 120)
+#define EXT_LABEL_SIZE			16
+#define EXT_MAGIC			0xef53
+
+#define PROBE_SIZE			(EXT_SB_OFFSET + 1024)
+
+typedef enum {
+	TARGET_NONE,
+	TARGET_UUID,
+	TARGET_PARTUUID,
+	TARGET_LABEL,
+	TARGET_PARTLABEL,
+	TARGET_RAWDEV,
+} target_type_t;
+
+static unsigned long opt_timeout_ms = DEFAULT_TIMEOUT_MSEC;
+static bool opt_luks;
+static target_type_t opt_target_type = TARGET_NONE;
+static char *opt_target;
+
+static void
+show_usage(char *prog)
+{
+	info_cont("\nUsage: %s <options> wait-dev <args> [<target>]\n", prog);
+	info_cont("\ntarget:\n");
+	info_cont("  The block device to be awaited, in the form of\n"
+		  "  UUID=, PARTUUID=, LABEL=, PARTLABEL= or the device\n"
+		  "  path. UUID= and LABEL= are matched against LUKS and\n"
+		  "  ext2/3/4 headers. The path of the device is printed\n"
+		  "  as soon as it shows up.\n");
+	info_cont("\nargs:\n");
+	info_cont("  --luks, -l:\n"
+		  "    (optional) Print the paths of the present LUKS\n"
+		  "    partitions without waiting\n");
+	info_cont("  --timeout, -t:\n"
+		  "    (optional) The timeout (in millisecond) upon\n"
+		  "    awaiting the target. 0 indicates infinite wait.\n"
+		  "    Default: %ld\n", DEFAULT_TIMEOUT_MSEC);
+}
+
+static int
+parse_target(char *target)
+{
+	static const struct {
+		const char *prefix;
+		target_type_t type;
+	} prefixes[] = {
+		{ "UUID=", TARGET_UUID },
+		{ "PARTUUID=", TARGET_PARTUUID },
+		{ "LABEL=", TARGET_LABEL },
+		{ "PARTLABEL=", TARGET_PARTLABEL },
+	};
+
+	for (unsigned int i = 0; i < sizeof(prefixes) /
+				     sizeof(prefixes[0]); ++i) {
+		size_t len = strlen(prefixes[i].prefix);
+
+		if (strncmp(target, prefixes[i].prefix, len))
+			continue;
+
+		opt_target_type = prefixes[i].type;
+		opt_target = target + len;
+
+		return *opt_target ? 0 : -1;
+	}
+
+	/* The device name is what the kernel reports in uevent */
+	char *name = strrchr(target, '/');
+
+	opt_target_type = TARGET_RAWDEV;
+	opt_target = name ? name + 1 : target;
+
+	return *opt_target ? 0 : -1;
+}
+
+static int
+parse_arg(int opt, char *optarg)
+{
+	switch (opt) {
+	case 'l':
+		opt_luks = true;
+		break;
+	case 't':
+		opt_timeout_ms = strtoul(optarg, NULL, 0);
+		break;
+	case 1:
+		if (opt_target) {
+			err("Only one target is allowed\n");
+			return -1;
+		}
+
+		if (parse_target(optarg)) {
+			err("Invalid target %s\n", optarg);
+			return -1;
+		}
+
+		break;
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+static unsigned long
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+static int
+read_sysfs(const char *name, const char *attr, char *buf, size_t size)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "/sys/class/block/%s/%s", name, attr);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	ssize_t len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+
+	buf[len] = 0;
+
+	return 0;
+}
+
+static int
+read_dev(const char *name, off_t offset, void *buf, size_t size)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "/dev/%s", name);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		dbg("Unable to open %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+
+	ssize_t len = pread(fd, buf, size, offset);
+	close(fd);
+	if (len != (ssize_t)size)
+		return -1;
+
+	return 0;
+}
+
+/* Compare the fixed-size and possibly unterminated field in header */
+static bool
+match_field(const char *field, size_t size, const char *value,
+	    bool ignore_case)
+{
+	size_t len = strnlen(field, size);
+
+	if (len != strlen(value))
+		return false;
+
+	if (ignore_case)
+		return !strncasecmp(field, value, len);
+
+	return !memcmp(field, value, len);
+}
+
+static void
+format_uuid(const uint8_t *uuid, bool mixed_endian, char *out)
+{
+	static const unsigned int order[2][16] = {
+		{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+		{ 3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15 },
+	};
+
+	for (unsigned int i = 0; i < 16; ++i) {
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			*out++ = '-';
+
+		out += sprintf(out, "%02x", uuid[order[mixed_endian][i]]);
+	}
+}
+
+/*
+ * The PARTUUID comes from the partition table of the parent disk, either
+ * the unique GUID in GPT entry or the MBR signature with the partition
+ * number.
+ */
+static int
+get_partuuid(const char *name, char *partuuid)
+{
+	char buf[PATH_MAX];
+
+	if (read_sysfs(name, "partition", buf, sizeof(buf)))
+		return -1;
+
+	unsigned long partno = strtoul(buf, NULL, 10);
+
+	char link[PATH_MAX];
+
+	snprintf(buf, sizeof(buf), "/sys/class/block/%s", name);
+
+	ssize_t len = readlink(buf, link, sizeof(link) - 1);
+	if (len < 0)
+		return -1;
+
+	link[len] = 0;
+
+	/* .../block/<disk>/<partition> */
+	char *p = strrchr(link, '/');
+	if (!p)
+		return -1;
+
+	*p = 0;
+
+	char *disk = strrchr(link, '/');
+	if (!disk)
+		return -1;
+
+	++disk;
+
+	unsigned long sector_size = 512;
+
+	if (!read_sysfs(disk, "queue/logical_block_size", buf, sizeof(buf)))
+		sector_size = strtoul(buf, NULL, 10);
+
+	uint8_t gpt[92];
+
+	if (read_dev(disk, sector_size, gpt, sizeof(gpt)))
+		return -1;
+
+	if (!memcmp(gpt, "EFI PART", 8)) {
+		uint64_t entry_lba;
+		uint32_t nr_entry, entry_size;
+
+		memcpy(&entry_lba, gpt + 72, sizeof(entry_lba));
+		memcpy(&nr_entry, gpt + 80, sizeof(nr_entry));
+		memcpy(&entry_size, gpt + 84, sizeof(entry_size));
+
+		if (!partno || partno > le32toh(nr_entry))
+			return -1;
+
+		uint8_t guid[16];
+
+		if (read_dev(disk, le64toh(entry_lba) * sector_size +
+			     (partno - 1) * le32toh(entry_size) + 16,
+			     guid, sizeof(guid)))
+			return -1;
+
+		format_uuid(guid, true, partuuid);
+
+		return 0;
+	}
+
+	uint8_t mbr[512];
+
+	if (read_dev(disk, 0, mbr, sizeof(mbr)) ||
+	    mbr[510] != 0x55 || mbr[511] != 0xaa)
+		return -1;
+
+	uint32_t signature;
+
+	memcpy(&signature, mbr + 440, sizeof(signature));
+	sprintf(partuuid, "%08x-%02lx", le32toh(signature), partno);
+
+	return 0;
+}
+
+/* PARTNAME is exported by the kernel for the named GPT partitions */
+static int
+get_partlabel(const char *name, char *partlabel, size_t size)
+{
+	char buf[4096];
+
+	if (read_sysfs(name, "uevent", buf, sizeof(buf)))
+		return -1;
+
+	char *p = strstr(buf, "PARTNAME=");
+	if (!p || (p != buf && p[-1] != '\n'))
+		return -1;
+
+	p += strlen("PARTNAME=");
+
+	size_t len = strcspn(p, "\n");
+	if (len >= size)
+		return -1;
+
+	memcpy(partlabel, p, len);
+	partlabel[len] = 0;
+
+	return 0;
+}
+
+static bool
+is_ext(const uint8_t *hdr)
+{
+	uint16_t magic;
+
+	memcpy(&magic, hdr + EXT_MAGIC_OFFSET, sizeof(magic));
+
+	return le16toh(magic) == EXT_MAGIC;
+}
+
+static bool
+is_luks2(const uint8_t *hdr)
+{
+	uint16_t version;
+
+	memcpy(&version, hdr + LUKS_VERSION_OFFSET, sizeof(version));
+
+	return be16toh(version) == LUKS2_VERSION;
+}
+
+static bool
+match_target(const char *name, const uint8_t *hdr, bool is_luks)
+{
+	char buf[256];
+
+	switch (opt_target_type) {
+	case TARGET_UUID:
+		if (is_luks)
+			return match_field((char *)hdr + LUKS_UUID_OFFSET,
+					   LUKS_UUID_SIZE, opt_target, true);
+
+		if (is_ext(hdr) == false)
+			return false;
+
+		format_uuid(hdr + EXT_UUID_OFFSET, false, buf);
+
+		return !strcasecmp(buf, opt_target);
+	case TARGET_LABEL:
+		/*
+		 * LUKS1 doesn't have the label, and the same offset holds
+		 * the cipher name there.
+		 */
+		if (is_luks)
+			return is_luks2(hdr) == true &&
+			       match_field((char *)hdr + LUKS_LABEL_OFFSET,
+					   LUKS_LABEL_SIZE, opt_target,
+					   false);
+
+		if (is_ext(hdr) == true &&
+		    match_field((char *)hdr + EXT_LABEL_OFFSET,
+				EXT_LABEL_SIZE, opt_target, false))
+			return true;
+
+		/* Also try the partition label as blkid does */
+		return !get_partlabel(name, buf, sizeof(buf)) &&
+		       !strcmp(buf, opt_target);
+	case TARGET_PARTUUID:
+		return !get_partuuid(name, buf) &&
+		       !strcasecmp(buf, opt_target);
+	case TARGET_PARTLABEL:
+		return !get_partlabel(name, buf, sizeof(buf)) &&
+		       !strcmp(buf, opt_target);
+	case TARGET_RAWDEV:
+		return !strcmp(name, opt_target);
+	default:
+		return false;
+	}
+}
+
+/*
+ * Probe a single block device, and print its path if it is the target,
+ * or a LUKS partition with --luks.
+ */
+static bool
+probe_dev(const char *name)
+{
+	char buf[32];
+
+	/* Skip the device without media, e.g, the unbound loop device */
+	if (read_sysfs(name, "size", buf, sizeof(buf)) ||
+	    !strtoull(buf, NULL, 10))
+		return false;
+
+	bool found;
+
+	if (opt_target_type == TARGET_RAWDEV)
+		found = match_target(name, NULL, false);
+	else {
+		uint8_t hdr[PROBE_SIZE];
+
+		if (read_dev(name, 0, hdr, sizeof(hdr)))
+			return false;
+
+		bool is_luks = !memcmp(hdr, LUKS_MAGIC, LUKS_MAGIC_SIZE);
+
+		dbg("Probed %s%s\n", name, is_luks ? " (LUKS)" : "");
+
+		found = opt_luks ? is_luks : match_target(name, hdr, is_luks);
+	}
+
+	if (found == true)
+		info_cont("/dev/%s\n", name);
+
+	return found;
+}
+
+static bool
+scan_devs(void)
+{
+	DIR *dir = opendir("/sys/class/block");
+
+	if (!dir) {
+		err("Unable to open /sys/class/block (%s)\n",
+		    strerror(errno));
+		return false;
+	}
+
+	struct dirent *de;
+	bool found = false;
+
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] == '.')
+			continue;
+
+		if (probe_dev(de->d_name) == true) {
+			found = true;
+
+			/* All LUKS partitions are listed */
+			if (!opt_luks)
+				break;
+		}
+	}
+
+	closedir(dir);
+
+	return found;
+}
+
+static int
+uevent_init(void)
+{
+	int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		dbg("Unable to create uevent socket (%s)\n", strerror(errno));
+		return -1;
+	}
+
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_pid = 0,
+		/* The kernel multicast group, not the one of udevd */
+		.nl_groups = 1,
+	};
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		dbg("Unable to bind uevent socket (%s)\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	/* Best effort to hold a burst of uevents on the hosts with many disks */
+	int size = 1024 * 1024;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)))
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	return fd;
+}
+
+/*
+ * Drain the pending uevents and probe the block devices added or
+ * changed, e.g, a dm device gets its table loaded. If the socket buffer
+ * overflowed during a burst of uevents, the dropped ones are recovered
+ * by a full scan.
+ */
+static bool
+uevent_probe(int fd)
+{
+	char buf[8192];
+	bool overrun = false;
+
+	while (1) {
+		const char *action = NULL, *subsystem = NULL;
+		const char *devname = NULL;
+		ssize_t len = recv(fd, buf, sizeof(buf) - 1, 0);
+
+		if (len < 0 && errno == ENOBUFS) {
+			overrun = true;
+			continue;
+		}
+
+		if (len <= 0)
+			break;
+
+		buf[len] = 0;
+
+		for (char *p = buf; p < buf + len; p += strlen(p) + 1) {
+			if (!strncmp(p, "ACTION=", 7))
+				action = p + 7;
+			else if (!strncmp(p, "SUBSYSTEM=", 10))
+				subsystem = p + 10;
+			else if (!strncmp(p, "DEVNAME=", 8))
+				devname = p + 8;
+		}
+
+		if (!action || !subsystem || !devname ||
+		    strcmp(subsystem, "block"))
+			continue;
+
+		if (strcmp(action, "add") && strcmp(action, "change"))
+			continue;
+
+		if (probe_dev(devname) == true)
+			return true;
+	}
+
+	if (overrun == true) {
+		dbg("Rescan the block devices due to the uevents dropped\n");
+		return scan_devs();
+	}
+
+	return false;
+}
+
+static int
+run_wait_dev(char *prog)
+{
+	if (!opt_target == !opt_luks) {
+		err("Either --luks or the target must be specified\n");
+		return EXIT_FAILURE;
+	}
+
+	if (opt_luks) {
+		scan_devs();
+		return EXIT_SUCCESS;
+	}
+
+	/* Listen before the first scan so that no device is missed */
+	int fd = uevent_init();
+
+	if (scan_devs() == true) {
+		if (fd >= 0)
+			close(fd);
+
+		return EXIT_SUCCESS;
+	}
+
+	unsigned long start_ms = now_ms();
+	int ret = EXIT_FAILURE;
+
+	while (1) {
+		unsigned long total_delay_ms = now_ms() - start_ms;
+
+		if (total_delay_ms >= opt_timeout_ms && opt_timeout_ms) {
+			err("Timeout upon awaiting the block device\n");
+			break;
+		}
+
+		unsigned long wait_ms = opt_timeout_ms ?
+					opt_timeout_ms - total_delay_ms : ~0UL;
+
+		if (fd < 0) {
+			/* Fall back to rescan all block devices */
+			if (wait_ms > POLL_INTERVAL_MSEC)
+				wait_ms = POLL_INTERVAL_MSEC;
+
+			struct timespec req = {
+				.tv_sec = wait_ms / 1000,
+				.tv_nsec = (wait_ms % 1000) * 1000000,
+			};
+
+			while (nanosleep(&req, &req) && errno == EINTR)
+				;
+
+			if (scan_devs() == true) {
+				ret = EXIT_SUCCESS;
+				break;
+			}
+
+			continue;
+		}
+
+		struct pollfd pfd = {
+			.fd = fd,
+			.events = POLLIN,
+		};
+
+		if (poll(&pfd, 1, opt_timeout_ms ? (int)wait_ms : -1) <= 0)
+			continue;
+
+		if (uevent_probe(fd) == true) {
+			ret = EXIT_SUCCESS;
+			break;
+		}
+	}
+
+	if (fd >= 0)
+		close(fd);
+
+	return ret;
+}
+
+static struct option long_opts[] = {
+	{ "luks", no_argument, NULL, 'l' },
+	{ "timeout", required_argument, NULL, 't' },
+	{ 0 },	/* NULL terminated */
+};
+
+subcommand_t subcommand_wait_dev = {
+	.name = "wait-dev",
+	.optstring = "-lt:",
+	.long_opts = long_opts,
+	.parse_arg = parse_arg,
+	.show_usage = show_usage,
+	.run = run_wait_dev,
+};